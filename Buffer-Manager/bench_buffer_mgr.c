@@ -0,0 +1,837 @@
+#include "storage_mgr.h"
+#include "buffer_mgr.h"
+#include "dberror.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+// micro benchmarks for the buffer manager, run as "bench1 [name]"
+
+#define BENCH_FILE "benchbuffer.bin"
+
+static double
+nowInNs (void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static const char *
+stratName (ReplacementStrategy strategy)
+{
+  switch (strategy)
+    {
+    case RS_FIFO: return "FIFO";
+    case RS_LRU: return "LRU";
+    case RS_CLOCK: return "CLOCK";
+    case RS_LFU: return "LFU";
+    case RS_LRU_K: return "LRU-K";
+    case RS_ARC: return "ARC";
+    case RS_2Q: return "2Q";
+    case RS_CLOCK_LOCKFREE: return "CLOCK-LF";
+    default: return "?";
+    }
+}
+
+// create a page file with numPages pages
+static void
+createBenchFile (int numPages)
+{
+  SM_FileHandle fh;
+
+  CHECK(createPageFile(BENCH_FILE));
+  CHECK(openPageFile(BENCH_FILE, &fh));
+  CHECK(ensureCapacity(numPages, &fh));
+  CHECK(closePageFile(&fh));
+}
+
+// read heavy workload: the whole working set fits the pool, so after warm up
+// every pin is a hit and only the hit path of the strategy is measured.
+// 90% of the requests go to 10% of the pages.
+static void
+benchHitPath (ReplacementStrategy strategy, int numFrames, int numOps)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  int *requests = malloc(numOps * sizeof(int));
+  int hot = numFrames / 10;
+  double start, elapsed;
+  int i;
+
+  srand(42);
+  for (i = 0; i < numOps; i++)
+    requests[i] = (rand() % 10 != 0) ? rand() % hot : rand() % numFrames;
+
+  CHECK(initBufferPool(bm, BENCH_FILE, numFrames, strategy, NULL));
+  for (i = 0; i < numFrames; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      CHECK(unpinPage(bm, h));
+    }
+
+  start = nowInNs();
+  for (i = 0; i < numOps; i++)
+    {
+      pinPage(bm, h, requests[i]);
+      unpinPage(bm, h);
+    }
+  elapsed = nowInNs() - start;
+
+  printf("hit-path %-6s frames=%-6d ops=%-8d %8.1f ns/pin+unpin\n",
+	 stratName(strategy), numFrames, numOps, elapsed / numOps);
+
+  CHECK(shutdownBufferPool(bm));
+  free(requests);
+  free(h);
+  free(bm);
+}
+
+static void
+runHitPath (void)
+{
+  int frames[] = { 1024, 16384 };
+  int i;
+
+  for (i = 0; i < 2; i++)
+    {
+      createBenchFile(frames[i]);
+      benchHitPath(RS_LRU, frames[i], 2000000);
+      benchHitPath(RS_CLOCK, frames[i], 2000000);
+      benchHitPath(RS_LFU, frames[i], 2000000);
+      benchHitPath(RS_LRU_K, frames[i], 2000000);
+      CHECK(destroyPageFile(BENCH_FILE));
+    }
+}
+
+static const char *
+ioModeName (SM_IOMode mode)
+{
+  switch (mode)
+    {
+    case SM_IO_BUFFERED: return "buffered";
+    case SM_IO_DIRECT: return "direct";
+    case SM_IO_MMAP: return "mmap";
+    default: return "?";
+    }
+}
+
+// uniform random reads over a file eight times the pool, so nearly every pin
+// is a miss served by the storage manager. The file is warm in the page cache
+// except for direct I/O, which always goes to the device.
+static void
+benchMissPath (SM_IOMode mode, int numFrames, int filePages, int numOps)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  double start, elapsed;
+  int i;
+
+  srand(11);
+  CHECK(initBufferPoolWithMode(bm, BENCH_FILE, numFrames, RS_CLOCK, NULL, mode));
+  CHECK(adviseBufferPool(bm, SM_ADVICE_RANDOM, 0, 0));
+
+  start = nowInNs();
+  for (i = 0; i < numOps; i++)
+    {
+      pinPage(bm, h, rand() % filePages);
+      unpinPage(bm, h);
+    }
+  elapsed = nowInNs() - start;
+
+  printf("miss-path %-8s frames=%-6d file=%-6d %8.1f ns/pin+unpin, %d reads\n",
+	 ioModeName(mode), numFrames, filePages, elapsed / numOps, getNumReadIO(bm));
+
+  CHECK(shutdownBufferPool(bm));
+  free(h);
+  free(bm);
+}
+
+static void
+runMissPath (void)
+{
+  createBenchFile(8192);
+  benchMissPath(SM_IO_BUFFERED, 1024, 8192, 200000);
+  benchMissPath(SM_IO_MMAP, 1024, 8192, 200000);
+  benchMissPath(SM_IO_DIRECT, 1024, 8192, 200000);
+  CHECK(destroyPageFile(BENCH_FILE));
+}
+
+// checkpoint cost: dirty every frame of the pool, then time one forceFlushPool
+static void
+benchFlush (SM_IOMode mode, SM_BatchEngine engine, int numFrames)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  double start, elapsed;
+  int i;
+
+  setBatchWriteEngine(engine);
+  CHECK(initBufferPoolWithMode(bm, BENCH_FILE, numFrames, RS_CLOCK, NULL, mode));
+  for (i = 0; i < numFrames; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      h->data[0] = i;
+      CHECK(markDirty(bm, h));
+      CHECK(unpinPage(bm, h));
+    }
+
+  start = nowInNs();
+  CHECK(forceFlushPool(bm));
+  elapsed = nowInNs() - start;
+
+  printf("flush %-8s %-8s frames=%-6d %8.1f ms, %6.1f us/page\n", ioModeName(mode),
+	 (engine == SM_BATCH_THREADS) ? "threads" : "io_uring", numFrames, elapsed / 1e6, elapsed / 1e3 / numFrames);
+
+  CHECK(shutdownBufferPool(bm));
+  setBatchWriteEngine(SM_BATCH_AUTO);
+  free(h);
+  free(bm);
+}
+
+static void
+runFlush (void)
+{
+  createBenchFile(50000);
+  benchFlush(SM_IO_BUFFERED, SM_BATCH_AUTO, 50000);
+  benchFlush(SM_IO_BUFFERED, SM_BATCH_THREADS, 50000);
+  benchFlush(SM_IO_DIRECT, SM_BATCH_AUTO, 50000);
+  benchFlush(SM_IO_DIRECT, SM_BATCH_THREADS, 50000);
+  CHECK(destroyPageFile(BENCH_FILE));
+}
+
+// range scan over a file eight times the pool, with and without read-ahead
+static void
+benchSequentialScan (SM_IOMode mode, int readAhead, int numFrames, int filePages)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  double start, elapsed;
+  int i;
+
+  CHECK(initBufferPoolWithMode(bm, BENCH_FILE, numFrames, RS_CLOCK, NULL, mode));
+  CHECK(setReadAhead(bm, readAhead));
+
+  start = nowInNs();
+  for (i = 0; i < filePages; i++)
+    {
+      pinPage(bm, h, i);
+      unpinPage(bm, h);
+    }
+  elapsed = nowInNs() - start;
+
+  printf("seq-scan %-8s read-ahead=%-3d %8.1f ns/page, %d reads (%d ahead)\n",
+	 ioModeName(mode), readAhead, elapsed / filePages, getNumReadIO(bm), getNumReadAheadIO(bm));
+
+  CHECK(shutdownBufferPool(bm));
+  free(h);
+  free(bm);
+}
+
+static void
+runSequentialScan (void)
+{
+  createBenchFile(8192);
+  benchSequentialScan(SM_IO_DIRECT, 0, 1024, 8192);
+  benchSequentialScan(SM_IO_DIRECT, 32, 1024, 8192);
+  benchSequentialScan(SM_IO_BUFFERED, 0, 1024, 8192);
+  benchSequentialScan(SM_IO_BUFFERED, 32, 1024, 8192);
+  CHECK(destroyPageFile(BENCH_FILE));
+}
+
+static int
+compareDoubles (const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+// write heavy workload: random pages over a file eight times the pool, half of
+// them modified. Reports the pinPage latency distribution, with and without a
+// background writer cleaning victims ahead of eviction.
+static void
+benchDirtyEviction (SM_IOMode mode, bool withWriter, int numFrames, int filePages, int numOps)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  double *latency = malloc(numOps * sizeof(double));
+  double start;
+  int i;
+
+  srand(5);
+  CHECK(initBufferPoolWithMode(bm, BENCH_FILE, numFrames, RS_LRU, NULL, mode));
+  if (withWriter)
+    CHECK(startBackgroundWriter(bm, NULL));
+  for (i = 0; i < numOps; i++)
+    {
+      start = nowInNs();
+      pinPage(bm, h, rand() % filePages);
+      latency[i] = nowInNs() - start;
+      if (rand() % 2)
+	markDirty(bm, h);
+      unpinPage(bm, h);
+    }
+  qsort(latency, numOps, sizeof(double), compareDoubles);
+
+  printf("dirty-evict %-8s writer=%-3s p50 %7.1f us  p99 %7.1f us  p99.9 %7.1f us  writes %d (%d background)\n",
+	 ioModeName(mode), withWriter ? "on" : "off", latency[numOps / 2] / 1e3,
+	 latency[numOps / 100 * 99] / 1e3, latency[numOps / 1000 * 999] / 1e3,
+	 getNumWriteIO(bm), getNumBackgroundWriteIO(bm));
+
+  CHECK(shutdownBufferPool(bm));
+  free(latency);
+  free(h);
+  free(bm);
+}
+
+static void
+runDirtyEviction (void)
+{
+  createBenchFile(8192);
+  benchDirtyEviction(SM_IO_DIRECT, FALSE, 1024, 8192, 100000);
+  benchDirtyEviction(SM_IO_DIRECT, TRUE, 1024, 8192, 100000);
+  benchDirtyEviction(SM_IO_BUFFERED, FALSE, 1024, 8192, 100000);
+  benchDirtyEviction(SM_IO_BUFFERED, TRUE, 1024, 8192, 100000);
+  CHECK(destroyPageFile(BENCH_FILE));
+}
+
+// a hot set that fits the pool while full scans of a file several times the
+// pool size run alongside, one scan page for every four hot lookups. The
+// scan pins plainly or through a BM_ACCESS_BULK_READ ring. Reports the hit
+// ratio of the hot set lookups only.
+static void
+benchScanMix (ReplacementStrategy strategy, BM_AccessType scanAccess, int numFrames, int filePages, int rounds)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  BM_AccessStrategy *ring;
+  int hot = numFrames / 2;
+  int lookups = 0, misses = 0;
+  int r, i, j, before;
+
+  srand(7);
+  CHECK(initBufferPool(bm, BENCH_FILE, numFrames, strategy, NULL));
+  ring = getAccessStrategy(bm, scanAccess);
+  for (r = 0; r < rounds; r++)
+    for (i = hot; i < filePages; i++)
+      {
+	for (j = 0; j < 4; j++)
+	  {
+	    before = getNumReadIO(bm);
+	    pinPage(bm, h, rand() % hot);
+	    unpinPage(bm, h);
+	    lookups++;
+	    misses += getNumReadIO(bm) - before;
+	  }
+	pinPageWithStrategy(bm, h, i, ring);
+	unpinPage(bm, h);
+      }
+  freeAccessStrategy(ring);
+
+  printf("scan-mix %-6s scan=%-4s frames=%-6d file=%-6d hot set hit ratio %5.1f%%\n",
+	 stratName(strategy), (ring != NULL) ? "ring" : "pin", numFrames, filePages,
+	 100.0 * (lookups - misses) / lookups);
+
+  CHECK(shutdownBufferPool(bm));
+  free(h);
+  free(bm);
+}
+
+static void
+runScanMix (void)
+{
+  ReplacementStrategy strategies[] = { RS_LRU, RS_CLOCK, RS_LFU, RS_LRU_K, RS_ARC, RS_2Q };
+  int i;
+
+  createBenchFile(8192);
+  for (i = 0; i < 6; i++)
+    {
+      benchScanMix(strategies[i], BM_ACCESS_NORMAL, 1024, 8192, 3);
+      benchScanMix(strategies[i], BM_ACCESS_BULK_READ, 1024, 8192, 3);
+    }
+  CHECK(destroyPageFile(BENCH_FILE));
+}
+
+// concurrent pins: every thread pins and unpins pages of a file four times
+// the pool, 90% of them from a hot set of half the pool, and marks every
+// tenth page dirty. The total work is fixed, reports pins per second, for
+// one pool and for the pool split into shards.
+struct benchThread {
+  BM_BufferPool *bm;
+  int filePages;
+  int hot;
+  int numOps;
+  unsigned seed;
+};
+
+static void *
+benchThreadMain (void *arg)
+{
+  struct benchThread *thread = arg;
+  BM_PageHandle h;
+  int i, pageNum;
+
+  for (i = 0; i < thread->numOps; i++)
+    {
+      thread->seed = thread->seed * 1103515245 + 12345;
+      pageNum = (thread->seed >> 8) % 10 != 0 ? (thread->seed >> 12) % thread->hot : (thread->seed >> 12) % thread->filePages;
+      if (pinPage(thread->bm, &h, pageNum) != RC_OK)
+	continue;
+      if (i % 10 == 0)
+	markDirty(thread->bm, &h);
+      unpinPage(thread->bm, &h);
+    }
+  return NULL;
+}
+
+static void
+benchThreads (ReplacementStrategy strategy, int numShards, int numThreads, int numFrames, int filePages, int numOps)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  struct benchThread *threads = malloc(numThreads * sizeof(struct benchThread));
+  pthread_t *ids = malloc(numThreads * sizeof(pthread_t));
+  double start, elapsed;
+  int i;
+
+  CHECK(initBufferPoolSharded(bm, BENCH_FILE, numFrames, strategy, NULL, SM_IO_BUFFERED, numShards));
+  start = nowInNs();
+  for (i = 0; i < numThreads; i++)
+    {
+      threads[i].bm = bm;
+      threads[i].filePages = filePages;
+      threads[i].hot = numFrames / 2;
+      threads[i].numOps = numOps / numThreads;
+      threads[i].seed = i + 1;
+      pthread_create(&ids[i], NULL, benchThreadMain, &threads[i]);
+    }
+  for (i = 0; i < numThreads; i++)
+    pthread_join(ids[i], NULL);
+  elapsed = nowInNs() - start;
+
+  printf("threads  %-8s shards=%-3d threads=%-3d frames=%-6d file=%-6d %10.0f pins/s, %d reads\n",
+	 stratName(strategy), numShards, numThreads, numFrames, filePages, (double) numOps / (elapsed / 1e9), getNumReadIO(bm));
+
+  CHECK(shutdownBufferPool(bm));
+  free(ids);
+  free(threads);
+  free(bm);
+}
+
+static void
+runThreads (void)
+{
+  int threads[] = { 1, 2, 4, 8, 16, 32, 64 };
+  int i;
+
+  createBenchFile(4096);
+  for (i = 0; i < 7; i++)
+    benchThreads(RS_LRU, 1, threads[i], 1024, 4096, 640000);
+  for (i = 0; i < 7; i++)
+    benchThreads(RS_LRU, 16, threads[i], 1024, 4096, 640000);
+  for (i = 0; i < 7; i++)
+    benchThreads(RS_CLOCK, 1, threads[i], 1024, 4096, 640000);
+  for (i = 0; i < 7; i++)
+    benchThreads(RS_CLOCK, 16, threads[i], 1024, 4096, 640000);
+  for (i = 0; i < 7; i++)
+    benchThreads(RS_CLOCK_LOCKFREE, 1, threads[i], 1024, 4096, 640000);
+  CHECK(destroyPageFile(BENCH_FILE));
+}
+
+// index probes: every thread descends from a root page through one of 8
+// inner pages to a leaf, reading a key from each, the way a B-tree lookup
+// does. The root and inner pages are read with a pin, a pin and a shared
+// latch, or optimistically; leaves are always pinned. Reports probes per second.
+enum probeMode { PROBE_PIN, PROBE_LATCH, PROBE_OPTIMISTIC };
+
+struct benchProbe {
+  BM_BufferPool *bm;
+  enum probeMode mode;
+  int numOps;
+  unsigned seed;
+  long sum;
+};
+
+static int
+probeRead (struct benchProbe *probe, BM_PageHandle *h, PageNumber pageNum)
+{
+  unsigned int version;
+  int key;
+
+  if (probe->mode == PROBE_OPTIMISTIC)
+    while (beginOptimisticRead(probe->bm, h, pageNum, &version) == RC_OK)
+      {
+	key = __atomic_load_n((int *) h->data, __ATOMIC_RELAXED);
+	if (validateOptimisticRead(probe->bm, h, version))
+	  return key;
+      }
+  CHECK(pinPage(probe->bm, h, pageNum));
+  if (probe->mode == PROBE_LATCH)
+    CHECK(latchPage(probe->bm, h, BM_LATCH_SHARED));
+  key = __atomic_load_n((int *) h->data, __ATOMIC_RELAXED);
+  if (probe->mode == PROBE_LATCH)
+    CHECK(unlatchPage(probe->bm, h));
+  CHECK(unpinPage(probe->bm, h));
+  return key;
+}
+
+static void *
+benchProbeMain (void *arg)
+{
+  struct benchProbe *probe = arg;
+  BM_PageHandle root = { NO_PAGE, NULL }, inner = { NO_PAGE, NULL }, leaf;
+  int i, innerPage;
+
+  for (i = 0; i < probe->numOps; i++)
+    {
+      probe->seed = probe->seed * 1103515245 + 12345;
+      innerPage = 1 + (probe->seed >> 8) % 8;
+      probe->sum += probeRead(probe, &root, 0);
+      probe->sum += probeRead(probe, &inner, innerPage);
+      CHECK(pinPage(probe->bm, &leaf, 9 + (probe->seed >> 12) % 1000));
+      probe->sum += *(int *) leaf.data;
+      CHECK(unpinPage(probe->bm, &leaf));
+    }
+  return NULL;
+}
+
+static void
+benchProbes (enum probeMode mode, int numThreads, int numOps)
+{
+  const char *names[] = { "pin", "latch", "optimistic" };
+  BM_BufferPool *bm = MAKE_POOL();
+  struct benchProbe *probes = malloc(numThreads * sizeof(struct benchProbe));
+  pthread_t *ids = malloc(numThreads * sizeof(pthread_t));
+  BM_PageHandle h;
+  double start, elapsed;
+  int i;
+
+  CHECK(initBufferPool(bm, BENCH_FILE, 1024, RS_CLOCK, NULL));
+  for (i = 0; i < 1009; i++)
+    {
+      CHECK(pinPage(bm, &h, i));
+      CHECK(unpinPage(bm, &h));
+    }
+  start = nowInNs();
+  for (i = 0; i < numThreads; i++)
+    {
+      probes[i].bm = bm;
+      probes[i].mode = mode;
+      probes[i].numOps = numOps / numThreads;
+      probes[i].seed = i + 1;
+      probes[i].sum = 0;
+      pthread_create(&ids[i], NULL, benchProbeMain, &probes[i]);
+    }
+  for (i = 0; i < numThreads; i++)
+    pthread_join(ids[i], NULL);
+  elapsed = nowInNs() - start;
+
+  printf("probe    %-10s threads=%-3d %10.0f probes/s\n",
+	 names[mode], numThreads, (double) numOps / (elapsed / 1e9));
+
+  CHECK(shutdownBufferPool(bm));
+  free(ids);
+  free(probes);
+  free(bm);
+}
+
+static void
+runProbes (void)
+{
+  int threads[] = { 1, 4, 16 };
+  int i, mode;
+
+  createBenchFile(1009);
+  for (mode = PROBE_PIN; mode <= PROBE_OPTIMISTIC; mode++)
+    for (i = 0; i < 3; i++)
+      benchProbes(mode, threads[i], 1000000);
+  CHECK(destroyPageFile(BENCH_FILE));
+}
+
+// a join fetching its next 64 pages: eight runs of eight consecutive pages
+// at random places of a file eight times the pool, pinned one pinPage at a
+// time or with one pinPages call, then unpinned. Nearly every page misses.
+#define BATCH_PAGES 64
+
+static void
+benchBatchPins (SM_IOMode mode, bool batched, int numFrames, int filePages, int rounds)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle handles[BATCH_PAGES];
+  PageNumber pageNums[BATCH_PAGES];
+  double start, elapsed;
+  int r, i;
+
+  srand(17);
+  CHECK(initBufferPoolWithMode(bm, BENCH_FILE, numFrames, RS_CLOCK, NULL, mode));
+
+  start = nowInNs();
+  for (r = 0; r < rounds; r++)
+    {
+      for (i = 0; i < BATCH_PAGES; i++)
+	pageNums[i] = (i % 8 == 0) ? rand() % (filePages - 8) : pageNums[i - 1] + 1;
+      if (batched)
+	{
+	  CHECK(pinPages(bm, handles, pageNums, BATCH_PAGES));
+	}
+      else
+	{
+	  for (i = 0; i < BATCH_PAGES; i++)
+	    CHECK(pinPage(bm, &handles[i], pageNums[i]));
+	}
+      CHECK(unpinPages(bm, handles, BATCH_PAGES));
+    }
+  elapsed = nowInNs() - start;
+
+  printf("batch %-8s %-8s frames=%-6d file=%-6d %8.1f us/%d pages, %d reads\n",
+	 ioModeName(mode), batched ? "pinPages" : "pinPage", numFrames, filePages,
+	 elapsed / rounds / 1000, BATCH_PAGES, getNumReadIO(bm));
+
+  CHECK(shutdownBufferPool(bm));
+  free(bm);
+}
+
+static void
+runBatchPins (void)
+{
+  createBenchFile(8192);
+  benchBatchPins(SM_IO_BUFFERED, FALSE, 1024, 8192, 2000);
+  benchBatchPins(SM_IO_BUFFERED, TRUE, 1024, 8192, 2000);
+  benchBatchPins(SM_IO_DIRECT, FALSE, 1024, 8192, 500);
+  benchBatchPins(SM_IO_DIRECT, TRUE, 1024, 8192, 500);
+  CHECK(destroyPageFile(BENCH_FILE));
+}
+
+// random page reads of a file eight times the pool with depth asynchronous
+// pins kept in flight: the oldest one is waited for, unpinned and replaced.
+// Depth 0 pins with pinPage, one read at a time.
+#define QD_MAX 64
+
+static void
+benchQueueDepth (SM_IOMode mode, int depth, int numFrames, int filePages, int numOps)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PinRequest *requests[QD_MAX];
+  BM_PageHandle page;
+  double start, elapsed;
+  int i;
+
+  srand(23);
+  CHECK(initBufferPoolWithMode(bm, BENCH_FILE, numFrames, RS_CLOCK, NULL, mode));
+
+  start = nowInNs();
+  for (i = 0; i < numOps; i++)
+    {
+      if (depth == 0)
+	{
+	  CHECK(pinPage(bm, &page, rand() % filePages));
+	  CHECK(unpinPage(bm, &page));
+	  continue;
+	}
+      if (i >= depth)
+	{
+	  CHECK(waitPin(requests[i % depth], &page));
+	  CHECK(unpinPage(bm, &page));
+	}
+      CHECK(pinPageAsync(bm, rand() % filePages, &requests[i % depth]));
+    }
+  for (i = (numOps > depth ? numOps - depth : 0); depth > 0 && i < numOps; i++)
+    {
+      CHECK(waitPin(requests[i % depth], &page));
+      CHECK(unpinPage(bm, &page));
+    }
+  elapsed = nowInNs() - start;
+
+  printf("qd     %-8s depth=%-3d frames=%-6d file=%-6d %10.0f pages/s, %d reads\n",
+	 ioModeName(mode), depth, numFrames, filePages,
+	 numOps / (elapsed / 1e9), getNumReadIO(bm));
+
+  CHECK(shutdownBufferPool(bm));
+  free(bm);
+}
+
+static void
+runQueueDepth (void)
+{
+  int depths[] = { 0, 1, 4, 16, QD_MAX };
+  int i;
+
+  createBenchFile(8192);
+  for (i = 0; i < 5; i++)
+    benchQueueDepth(SM_IO_BUFFERED, depths[i], 1024, 8192, 50000);
+  for (i = 0; i < 5; i++)
+    benchQueueDepth(SM_IO_DIRECT, depths[i], 1024, 8192, 20000);
+  CHECK(destroyPageFile(BENCH_FILE));
+}
+
+// a scan split over numThreads threads: thread t pins pages t, t +
+// numThreads, ... of a file the pool holds in full, so the threads miss
+// neighbouring pages at the same time. Reports the reads issued for the
+// pages, as fewer reads for the same pages is what merging buys.
+struct benchScan {
+  BM_BufferPool *bm;
+  int filePages;
+  int first;
+  int step;
+};
+
+static void *
+benchScanMain (void *arg)
+{
+  struct benchScan *scan = arg;
+  BM_PageHandle h;
+  int i;
+
+  for (i = scan->first; i < scan->filePages; i += scan->step)
+    {
+      CHECK(pinPage(scan->bm, &h, i));
+      CHECK(unpinPage(scan->bm, &h));
+    }
+  return NULL;
+}
+
+static void
+benchMergedReads (SM_IOMode mode, int numThreads, int filePages)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  struct benchScan *scans = malloc(numThreads * sizeof(struct benchScan));
+  pthread_t *ids = malloc(numThreads * sizeof(pthread_t));
+  double start, elapsed;
+  int i;
+
+  CHECK(initBufferPoolWithMode(bm, BENCH_FILE, filePages, RS_CLOCK, NULL, mode));
+  start = nowInNs();
+  for (i = 0; i < numThreads; i++)
+    {
+      scans[i].bm = bm;
+      scans[i].filePages = filePages;
+      scans[i].first = i;
+      scans[i].step = numThreads;
+      pthread_create(&ids[i], NULL, benchScanMain, &scans[i]);
+    }
+  for (i = 0; i < numThreads; i++)
+    pthread_join(ids[i], NULL);
+  elapsed = nowInNs() - start;
+
+  printf("merge  %-8s threads=%-3d file=%-6d %8.2f ms, %d pages read with %d reads\n",
+	 ioModeName(mode), numThreads, filePages, elapsed / 1e6,
+	 getNumReadIO(bm), getNumReadIO(bm) - getNumMergedReadIO(bm));
+
+  CHECK(shutdownBufferPool(bm));
+  free(scans);
+  free(ids);
+  free(bm);
+}
+
+// the other side of merging: numThreads threads pin random pages of a file
+// 16 times the pool, so their misses are hardly ever neighbours and have to
+// be read side by side. Reports pins per second.
+struct benchMiss {
+  BM_BufferPool *bm;
+  int filePages;
+  int numOps;
+  unsigned seed;
+};
+
+static void *
+benchMissMain (void *arg)
+{
+  struct benchMiss *miss = arg;
+  BM_PageHandle h;
+  int i;
+
+  for (i = 0; i < miss->numOps; i++)
+    {
+      miss->seed = miss->seed * 1103515245 + 12345;
+      CHECK(pinPage(miss->bm, &h, (miss->seed >> 8) % miss->filePages));
+      CHECK(unpinPage(miss->bm, &h));
+    }
+  return NULL;
+}
+
+static void
+benchRandomMisses (SM_IOMode mode, int numThreads, int numFrames, int numOps)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  struct benchMiss *misses = malloc(numThreads * sizeof(struct benchMiss));
+  pthread_t *ids = malloc(numThreads * sizeof(pthread_t));
+  double start, elapsed;
+  int i;
+
+  CHECK(initBufferPoolWithMode(bm, BENCH_FILE, numFrames, RS_CLOCK, NULL, mode));
+  start = nowInNs();
+  for (i = 0; i < numThreads; i++)
+    {
+      misses[i].bm = bm;
+      misses[i].filePages = numFrames * 16;
+      misses[i].numOps = numOps / numThreads;
+      misses[i].seed = i + 1;
+      pthread_create(&ids[i], NULL, benchMissMain, &misses[i]);
+    }
+  for (i = 0; i < numThreads; i++)
+    pthread_join(ids[i], NULL);
+  elapsed = nowInNs() - start;
+
+  printf("misses %-8s threads=%-3d frames=%-6d file=%-6d %10.0f pins/s, %d reads\n",
+	 ioModeName(mode), numThreads, numFrames, numFrames * 16,
+	 (double) numOps / (elapsed / 1e9), getNumReadIO(bm));
+
+  CHECK(shutdownBufferPool(bm));
+  free(misses);
+  free(ids);
+  free(bm);
+}
+
+static void
+runMergedReads (void)
+{
+  int threads[] = { 1, 4, 16, 64 };
+  int i;
+
+  createBenchFile(4096);
+  for (i = 0; i < 4; i++)
+    benchMergedReads(SM_IO_BUFFERED, threads[i], 4096);
+  for (i = 0; i < 4; i++)
+    benchMergedReads(SM_IO_DIRECT, threads[i], 4096);
+  CHECK(destroyPageFile(BENCH_FILE));
+
+  createBenchFile(16384);
+  for (i = 0; i < 4; i++)
+    benchRandomMisses(SM_IO_DIRECT, threads[i], 1024, 100000);
+  CHECK(destroyPageFile(BENCH_FILE));
+}
+
+int
+main (int argc, char **argv)
+{
+  const char *which = (argc > 1) ? argv[1] : "all";
+
+  initStorageManager();
+
+  if (!strcmp(which, "all") || !strcmp(which, "hit"))
+    runHitPath();
+  if (!strcmp(which, "all") || !strcmp(which, "scan"))
+    runScanMix();
+  if (!strcmp(which, "all") || !strcmp(which, "miss"))
+    runMissPath();
+  if (!strcmp(which, "all") || !strcmp(which, "flush"))
+    runFlush();
+  if (!strcmp(which, "all") || !strcmp(which, "dirty"))
+    runDirtyEviction();
+  if (!strcmp(which, "all") || !strcmp(which, "seq"))
+    runSequentialScan();
+  if (!strcmp(which, "all") || !strcmp(which, "threads"))
+    runThreads();
+  if (!strcmp(which, "all") || !strcmp(which, "probe"))
+    runProbes();
+  if (!strcmp(which, "all") || !strcmp(which, "batch"))
+    runBatchPins();
+  if (!strcmp(which, "all") || !strcmp(which, "qd"))
+    runQueueDepth();
+  if (!strcmp(which, "all") || !strcmp(which, "merge"))
+    runMergedReads();
+
+  return 0;
+}
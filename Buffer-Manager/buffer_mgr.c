@@ -6,215 +6,1956 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
 #include "replacementStrategies.c"
 #include "dt.h"
 
 
-struct hash * createHashTable(int totalFrames) { 
-    struct hash *temp = (struct hash *) malloc(sizeof (struct hash *));
-    temp->capacity = MAX_CAPACITY;
-    temp->pageTable = (struct DLnode **) malloc(temp->capacity * sizeof (struct DLnode*));
-    int i;
-    for (i = 0; i < temp->capacity; ++i) {
-        temp->pageTable[i] = NULL;
-    }
+RC initBufferPool(BM_BufferPool * const bm, const char *const pageFileName, const int numPages, ReplacementStrategy strategy, void *stratData) {
+    return initBufferPoolWithMode(bm, pageFileName, numPages, strategy, stratData, SM_IO_BUFFERED);
+}
 
-    return temp;
+
+RC initBufferPoolWithMode(BM_BufferPool * const bm, const char *const pageFileName, const int numPages, ReplacementStrategy strategy, void *stratData, SM_IOMode ioMode) {
+    return initBufferPoolSharded(bm, pageFileName, numPages, strategy, stratData, ioMode, 1);
 }
 
-struct DLnode * createNewNode() {
-    struct DLnode *node = malloc(sizeof (struct DLnode));
-    node->pageNumber = NO_PAGE;
-    node->frameNum = 0;
-    node->dirty = 0;
-    node->fixcount = 0;
-    node->data = calloc(PAGE_SIZE, sizeof (SM_PageHandle));
-    node->next = NULL;
-    node->prev = NULL;
-    return node;
+
+/**********************************************************************************
+ * Shards
+ *
+ * A sharded pool splits its frames into shards that share nothing but the
+ * page file and the slab holding the frames. Each shard runs the pool's
+ * strategy over its own frames, with its own page table, counters and
+ * poolLock, so pins of pages in different shards never meet on a lock.
+ * The page file is cut into extents of SHARD_EXTENT_PAGES pages that are
+ * dealt to the shards round-robin: a run of consecutive pages stays in one
+ * shard, for vectored read-ahead and writes, while a hot range spreads
+ * evenly over all of them. (Hashing the extent number left some shards with
+ * several hot extents and tripled the misses of the threads benchmark.)
+ ***********************************************************************************/
+
+#define SHARD_EXTENT_PAGES 16
+#define SHARD_MIN_FRAMES 8 //a pool is never split into shards smaller than this
+
+static struct frameBudget *frameBudget = NULL; //set by setFrameBudget
+static RC joinFrameBudget(struct bufferPool *pool);
+static void leaveFrameBudget(struct bufferPool *pool);
+
+static inline struct queuePool * shardOf(struct bufferPool *pool, const PageNumber pageNum) {
+    if (pool->numShards == 1) {
+        return pool->shards;
+    }
+    return &pool->shards[((unsigned int) pageNum / SHARD_EXTENT_PAGES) % pool->numShards];
 }
 
+//sets up a shard over the numFrames frames of the pool from firstFrame on
+static void initShard(struct bufferPool *pool, struct queuePool *shard, int firstFrame, int numFrames, ReplacementStrategy strategy, void *stratData) {
+    bool *prefetched = pool->dirtyFlags + pool->totalNumFrames; //the flag arrays follow each other in the slab
+    int i;
 
-RC initBufferPool(BM_BufferPool * const bm, const char *const pageFileName, const int numPages, ReplacementStrategy strategy, void *stratData) {
+    shard->occupiedFrames = 0;
+    shard->totalNumFrames = numFrames;
+    shard->numRead = 0;
+    shard->numWrite = 0;
+    shard->numBackgroundWrite = 0;
+    shard->numReadAhead = 0;
+    shard->strategy = strategy;
+    shard->fileHandle = &pool->fileHandle;
+    shard->pageSize = pool->fileHandle.pageSize; //frames are as large as the pages of the file
+    shard->frameData = pool->frameData + (size_t) firstFrame * shard->pageSize;
+    shard->pageNumbers = pool->pageNumbers + firstFrame;
+    shard->fixCounts = pool->fixCounts + firstFrame;
+    shard->dirtyFlags = pool->dirtyFlags + firstFrame;
+    shard->prefetched = prefetched + firstFrame;
+    shard->ioInProgress = prefetched + pool->totalNumFrames + firstFrame;
+    shard->ringFrames = calloc(numFrames, sizeof (bool));
+    shard->dirtyVersions = calloc(numFrames, sizeof (unsigned int));
+    shard->frameLatches = malloc(numFrames * sizeof (pthread_mutex_t));
+    shard->ioDone = malloc(numFrames * sizeof (pthread_cond_t));
+    for (i = 0; i < numFrames; i++) {
+        pthread_mutex_init(&shard->frameLatches[i], NULL);
+        pthread_cond_init(&shard->ioDone[i], NULL);
+    }
+    if (posix_memalign((void **) &shard->pageLatches, CACHE_LINE_SIZE, numFrames * sizeof (struct pageLatch)) != 0) {
+        shard->pageLatches = NULL;
+    } else {
+        memset(shard->pageLatches, 0, numFrames * sizeof (struct pageLatch));
+    }
+    shard->dirtyFrames = 0;
+    shard->writerHighWater = 0;
+    shard->strategyData = createStrategyState(strategy, numFrames, stratData); //replacement state, indexed by frame number
+    shard->pageTable = createPageTable(numFrames); //page number to frame, striped for concurrent lookups
+    pthread_mutex_init(&shard->poolLock, NULL);
+    shard->share = (frameBudget != NULL) ? createBudgetShare(frameBudget, shard, SHARD_MIN_FRAMES) : NULL;
+    initReadQueue(&shard->reads);
+}
 
-    SM_FileHandle fHandle;
-    if (openPageFile((char*) pageFileName, &fHandle) != RC_OK) {
-        return RC_FILE_NOT_FOUND;
-    }
-    struct DLnode *new, *temp;
-    new = createNewNode(); // create doublylinked list node and assign values 
-    struct queuePool *queuePool = malloc(sizeof (struct queuePool)); //allocate memory to buffer pool
-    queuePool->occupiedFrames = 0;
-    queuePool->totalNumFrames = numPages;
-    queuePool->numRead = 0;
-    queuePool->numWrite = 0;
-    queuePool->front = queuePool->rear = new;
+static void freeShard(struct queuePool *shard) {
     int i;
-    for (i = 1; i < numPages; i++) {  //creating frames inside buffer pool
-        temp = createNewNode();
-        queuePool->rear->next = temp;
-        queuePool->rear->next->prev = queuePool->rear;
-        queuePool->rear = queuePool->rear->next;
-        queuePool->rear->frameNum = i;
+    for (i = 0; i < shard->totalNumFrames; i++) {
+        pthread_mutex_destroy(&shard->frameLatches[i]);
+        pthread_cond_destroy(&shard->ioDone[i]);
+    }
+    pthread_mutex_destroy(&shard->poolLock);
+    destroyReadQueue(&shard->reads);
+    free(shard->frameLatches);
+    free(shard->ioDone);
+    free(shard->pageLatches);
+    free(shard->ringFrames);
+    free(shard->dirtyVersions);
+    freeStrategyState(shard->strategy, shard->strategyData);
+    freePageTable(shard->pageTable);
+    if (shard->share != NULL) {
+        freeBudgetShare(shard->share);
+    }
+}
+
+
+RC initBufferPoolSharded(BM_BufferPool * const bm, const char *const pageFileName, const int numPages, ReplacementStrategy strategy, void *stratData, SM_IOMode ioMode, int numShards) {
+
+    if (strategy < RS_FIFO || strategy > RS_CLOCK_LOCKFREE) {
+        return NO_SUCH_METHOD;
+    }
+    struct bufferPool *pool = malloc(sizeof (struct bufferPool)); //allocate memory to buffer pool
+    RC status = openPageFileWithMode((char*) pageFileName, &pool->fileHandle, ioMode); //the file stays open for every read and write of the pool
+    if (status != RC_OK) {
+        free(pool);
+        return status;
+    }
+    if (numShards > numPages / SHARD_MIN_FRAMES) {
+        numShards = numPages / SHARD_MIN_FRAMES;
     }
+    pool->numShards = (numShards > 1) ? numShards : 1;
+    pool->totalNumFrames = numPages;
 
-    struct hash *hashTable = createHashTable(numPages); //creating hash table for storing the page numbers and the address of frames
+    //one slab holds the page data of every frame followed by the per frame metadata arrays.
+    //Frames are page aligned, so direct I/O reads and writes them in place. The mapping comes
+    //zeroed and takes memory only for the frames used, which the frame budget relies on.
+    size_t dataBytes = (size_t) numPages * pool->fileHandle.pageSize;
+    pool->slabBytes = dataBytes + numPages * (sizeof (PageNumber) + sizeof (int) + 3 * sizeof (bool));
+    void *slab = mmap(NULL, pool->slabBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (slab == MAP_FAILED) {
+        closePageFile(&pool->fileHandle);
+        free(pool);
+        return RC_MEMORY_ALLOCATION_ERROR;
+    }
+    pool->frameData = slab;
+    pool->pageNumbers = (PageNumber *) (pool->frameData + dataBytes);
+    pool->fixCounts = (int *) (pool->pageNumbers + numPages);
+    pool->dirtyFlags = (bool *) (pool->fixCounts + numPages); //then the prefetched and ioInProgress flags
+    int i, firstFrame = 0;
+    for (i = 0; i < numPages; i++) {
+        pool->pageNumbers[i] = NO_PAGE;
+    }
 
-    bm->mgmtData = queuePool;
-    bm->pageTableData = hashTable;
+    pool->shards = malloc(pool->numShards * sizeof (struct queuePool));
+    for (i = 0; i < pool->numShards; i++) { //the frames left over go to the first shards
+        int frames = numPages / pool->numShards + (i < numPages % pool->numShards ? 1 : 0);
+        initShard(pool, &pool->shards[i], firstFrame, frames, strategy, stratData);
+        firstFrame += frames;
+    }
+    pool->writer = NULL;
+    pthread_mutex_init(&pool->writerLock, NULL);
+    pool->readAhead.maxPages = 0; //off until setReadAhead
+    pool->readAhead.lastPage = NO_PAGE;
+    pool->readAhead.run = 0;
+    pool->readAhead.window = 0;
+    pool->readAhead.candidates = NULL;
+    pool->readAhead.held = NULL;
+    pthread_mutex_init(&pool->readAhead.lock, NULL);
+
+    bm->mgmtData = pool;
     bm->strategy = strategy;
     bm->numPages = numPages;
     bm->pageFile = (char*) pageFileName;
-    closePageFile(&fHandle);
+    if (frameBudget != NULL && (status = joinFrameBudget(pool)) != RC_OK) {
+        shutdownBufferPool(bm);
+        return status;
+    }
     return RC_OK;
 }
 
 
+/**********************************************************************************
+ * Pinning frames
+ ***********************************************************************************/
+
+//pins the frame holding pageNum, LIST_NONE when the page is not in the pool. Its I/O may still be in progress.
+static int pinResidentFrame(struct queuePool *queuePool, const PageNumber pageNum) {
+    pthread_mutex_t *lock = pageTableLock(queuePool->pageTable, pageNum);
+    int frame = pageTableLookup(queuePool->pageTable, pageNum);
+    if (frame != LIST_NONE) {
+        __atomic_add_fetch(&queuePool->fixCounts[frame], 1, __ATOMIC_ACQUIRE);
+    }
+    pthread_mutex_unlock(lock);
+    return frame;
+}
+
+//pins a frame by number if it holds a page that is loaded, for threads walking over the frames
+static bool pinLoadedFrame(struct queuePool *queuePool, int frame) {
+    PageNumber pageNum = __atomic_load_n(&queuePool->pageNumbers[frame], __ATOMIC_ACQUIRE);
+    bool pinned;
+
+    if (pageNum == NO_PAGE) {
+        return FALSE;
+    }
+    pthread_mutex_t *lock = pageTableLock(queuePool->pageTable, pageNum);
+    pinned = pageTableLookup(queuePool->pageTable, pageNum) == frame && !__atomic_load_n(&queuePool->ioInProgress[frame], __ATOMIC_ACQUIRE);
+    if (pinned) {
+        __atomic_add_fetch(&queuePool->fixCounts[frame], 1, __ATOMIC_ACQUIRE);
+    }
+    pthread_mutex_unlock(lock);
+    return pinned;
+}
+
+static inline void unpinFrame(struct queuePool *queuePool, int frame) {
+    __atomic_sub_fetch(&queuePool->fixCounts[frame], 1, __ATOMIC_RELEASE);
+}
+
+//waits for the I/O on a pinned frame, TRUE when the frame then holds pageNum
+static bool waitForFrame(struct queuePool *queuePool, int frame, const PageNumber pageNum) {
+    if (__atomic_load_n(&queuePool->ioInProgress[frame], __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&queuePool->frameLatches[frame]);
+        while (__atomic_load_n(&queuePool->ioInProgress[frame], __ATOMIC_ACQUIRE)) {
+            pthread_cond_wait(&queuePool->ioDone[frame], &queuePool->frameLatches[frame]);
+        }
+        pthread_mutex_unlock(&queuePool->frameLatches[frame]);
+    }
+    return __atomic_load_n(&queuePool->pageNumbers[frame], __ATOMIC_ACQUIRE) == pageNum;
+}
+
+//ends the I/O on a frame marked by fileFrame or takeFrame, the waiting threads go on
+static void endFrameIO(struct queuePool *queuePool, int frame) {
+    pthread_mutex_lock(&queuePool->frameLatches[frame]);
+    __atomic_store_n(&queuePool->ioInProgress[frame], FALSE, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&queuePool->ioDone[frame]);
+    pthread_mutex_unlock(&queuePool->frameLatches[frame]);
+}
+
+//pins an unpinned frame for takeFrame if it still holds oldPage. Without the pool lock
+//another thread may have claimed, refilled and unpinned the frame since oldPage was read.
+static bool claimFrame(struct queuePool *queuePool, int frame, const PageNumber oldPage) {
+    int unpinned = 0;
+    if (!__atomic_compare_exchange_n(&queuePool->fixCounts[frame], &unpinned, 1, FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return FALSE;
+    }
+    if (__atomic_load_n(&queuePool->pageNumbers[frame], __ATOMIC_ACQUIRE) != oldPage) {
+        unpinFrame(queuePool, frame);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+#define VICTIM_BUSY -2 //the victim was pinned meanwhile and went back to the strategy
+
+/**********************************************************************************
+ * Function Name: evictVictim
+ *
+ * Description:
+ *      evicts the page of a frame the strategy gave up, called with
+ *      lockStrategy held. A dirty victim is written back first with the pool
+ *      lock released and the frame marked busy, threads pinning the page
+ *      meanwhile wait for the write. A victim that can't be evicted goes back
+ *      to the strategy (strategyRestore), with cleanOnly a dirty one goes
+ *      back next in line for eviction.
+ *
+ * Return:
+ *      the frame, pinned once and holding no page, VICTIM_BUSY when it was
+ *      pinned meanwhile, or LIST_NONE with *status set to RC_WRITE_FAILED when
+ *      the write back failed and RC_OK when cleanOnly found it dirty
+ *
+ ***********************************************************************************/
+
+static int evictVictim(struct queuePool *queuePool, int frame, bool cleanOnly, RC *status) {
+
+    PageNumber oldPage = __atomic_load_n(&queuePool->pageNumbers[frame], __ATOMIC_ACQUIRE);
+    if (oldPage == NO_PAGE) { //left empty by a failed read, no thread can pin it
+        return claimFrame(queuePool, frame, NO_PAGE) ? frame : VICTIM_BUSY; //a lock free sweep took it as empty meanwhile
+    }
+    if (cleanOnly && frameIsDirty(queuePool, frame)) {
+        strategyAdmitPrefetched(queuePool, frame); //the page stays, next in line for eviction
+        *status = RC_OK;
+        return LIST_NONE;
+    }
+
+    pthread_mutex_t *lock = pageTableLock(queuePool->pageTable, oldPage);
+    if (!claimFrame(queuePool, frame, oldPage)) {
+        pthread_mutex_unlock(lock); //pinned since the strategy chose it
+        strategyRestore(queuePool, frame);
+        return VICTIM_BUSY;
+    }
+    if (frameIsDirty(queuePool, frame)) {
+        __atomic_store_n(&queuePool->ioInProgress[frame], TRUE, __ATOMIC_RELAXED); //pins meanwhile wait for the write
+        pthread_mutex_unlock(lock);
+        unlockStrategy(queuePool);
+        RC written = writeBlock(oldPage, queuePool->fileHandle, frameDataOf(queuePool, frame)); //when page is dirty writing the contents back to the disk
+        lockStrategy(queuePool);
+        if (written == RC_OK) { //the frame is claimed, no markDirty can come during the write
+            setFrameDirty(queuePool, frame, FALSE);
+            __atomic_add_fetch(&queuePool->numWrite, 1, __ATOMIC_RELAXED);
+        }
+        lock = pageTableLock(queuePool->pageTable, oldPage);
+        if (written != RC_OK || fixCountOf(queuePool, frame) != 1) { //the page stays
+            pthread_mutex_unlock(lock);
+            unpinFrame(queuePool, frame);
+            strategyRestore(queuePool, frame);
+            endFrameIO(queuePool, frame); //the threads that pinned it during the write go on
+            if (written != RC_OK) {
+                *status = RC_WRITE_FAILED;
+                return LIST_NONE;
+            }
+            return VICTIM_BUSY;
+        }
+        endFrameIO(queuePool, frame); //nobody waits
+    }
+    __atomic_add_fetch(&queuePool->pageLatches[frame].version, 2, __ATOMIC_ACQ_REL); //optimistic readers of the old page fail
+    pageTableRemove(queuePool->pageTable, oldPage, frame); //the evicted page is no longer in the buffer pool
+    __atomic_store_n(&queuePool->pageNumbers[frame], NO_PAGE, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(lock);
+    addBudgetGhost(queuePool, oldPage);
+    return frame;
+}
+
+/**********************************************************************************
+ * Function Name: takeFrame
+ *
+ * Description:
+ *      finds a frame for a new page, called with lockStrategy held: a free
+ *      frame, or the strategy's victim with its page evicted (evictVictim).
+ *      A victim pinned meanwhile goes back to the strategy and the search
+ *      goes on. With cleanOnly a dirty victim ends the search instead.
+ *      Without mayGrow the shard takes no frame from the frame budget, see
+ *      growFrame.
+ *
+ * Return:
+ *      the frame, pinned once and holding no page, or LIST_NONE with *status
+ *      set to PAGE_NODE_NOT_FOUND when every frame is pinned, RC_WRITE_FAILED
+ *      when the write back failed and RC_OK when cleanOnly found a dirty one
+ *
+ ***********************************************************************************/
+
+static int takeFrame(struct queuePool *queuePool, bool cleanOnly, bool mayGrow, RC *status) {
+
+    while (1) {
+        int frame = mayGrow ? growFrame(queuePool, FALSE) : LIST_NONE; //frames are filled in order until the pool is full
+        if (frame != LIST_NONE) {
+            if (claimFrame(queuePool, frame, NO_PAGE)) {
+                return frame;
+            }
+            continue; //a lock free sweep took it as empty meanwhile
+        }
+        frame = strategyVictim(queuePool);
+        if (frame == LIST_NONE && mayGrow) {
+            frame = growFrame(queuePool, TRUE); //a shard at its target with every frame pinned grows while the budget lasts
+            if (frame != LIST_NONE && claimFrame(queuePool, frame, NO_PAGE)) {
+                return frame;
+            }
+        }
+        if (frame == LIST_NONE) {
+            *status = PAGE_NODE_NOT_FOUND; //every frame is pinned
+            return LIST_NONE;
+        }
+        frame = evictVictim(queuePool, frame, cleanOnly, status);
+        if (frame != VICTIM_BUSY) {
+            return frame;
+        }
+    }
+}
+
+//TRUE when pageNum is filed under a frame, loaded or still being read
+static bool pageFiled(struct queuePool *queuePool, const PageNumber pageNum) {
+    pthread_mutex_t *lock = pageTableLock(queuePool->pageTable, pageNum);
+    bool filed = (pageTableLookup(queuePool->pageTable, pageNum) != LIST_NONE);
+    pthread_mutex_unlock(lock);
+    return filed;
+}
+
+//files pageNum under a frame from takeFrame, called with the pool lock held. The frame is marked
+//ioInProgress, threads pinning the page meanwhile wait for the read. FALSE when another thread got the page in first.
+static bool fileFrame(struct queuePool *queuePool, int frame, const PageNumber pageNum, bool prefetched) {
+    pthread_mutex_t *lock = pageTableLock(queuePool->pageTable, pageNum);
+
+    if (pageTableLookup(queuePool->pageTable, pageNum) != LIST_NONE) {
+        pthread_mutex_unlock(lock);
+        return FALSE;
+    }
+    __atomic_store_n(&queuePool->ioInProgress[frame], TRUE, __ATOMIC_RELAXED);
+    __atomic_store_n(&queuePool->pageNumbers[frame], pageNum, __ATOMIC_RELEASE);
+    __atomic_store_n(&queuePool->prefetched[frame], prefetched, __ATOMIC_RELAXED);
+    pageTableInsert(queuePool->pageTable, pageNum, frame);
+    pthread_mutex_unlock(lock);
+    return TRUE;
+}
+
+static void wakeBackgroundWriter(struct bufferPool *pool);
+static void readAheadAfterPin(struct bufferPool *pool, const PageNumber pageNum);
+static void rebalanceFrameBudget(struct frameBudget *budget);
+static void startFrameRead(struct queuePool *queuePool, int frame, BM_PinRequest *request, RC *status);
+
+//loads a page that was not found in the pool, with async the read is only started (startFrameRead). Returns its frame,
+//pinned, or LIST_NONE: with *status RC_OK when another thread loaded the page meanwhile and the pin has to look again.
+static int pinMissingPage(struct queuePool *queuePool, const PageNumber pageNum, BM_PinRequest *async, RC *status) {
+
+    lockStrategy(queuePool);
+    if (pageFiled(queuePool, pageNum)) { //another miss of the page came first, it is waited for as a hit without taking a frame
+        unlockStrategy(queuePool);
+        *status = RC_OK;
+        return LIST_NONE;
+    }
+    strategyMiss(queuePool, pageNum);
+    budgetMiss(queuePool, pageNum);
+    int frame = takeFrame(queuePool, FALSE, TRUE, status);
+    if (frame == LIST_NONE) {
+        unlockStrategy(queuePool);
+        return LIST_NONE;
+    }
+    if (!fileFrame(queuePool, frame, pageNum, FALSE)) {
+        unpinFrame(queuePool, frame);
+        strategyAdmit(queuePool, frame); //the frame goes back empty
+        unlockStrategy(queuePool);
+        *status = RC_OK;
+        return LIST_NONE;
+    }
+    strategyAdmit(queuePool, frame); //the frame goes back to the strategy even when loading fails, it is then empty
+    unlockStrategy(queuePool);
+
+    if (async != NULL) {
+        startFrameRead(queuePool, frame, async, status);
+        return (*status == RC_OK) ? frame : LIST_NONE;
+    }
+    *status = changeFrameContent(queuePool, frame, pageNum); //no pool lock during the read
+    endFrameIO(queuePool, frame);
+    if (*status != RC_OK) {
+        unpinFrame(queuePool, frame);
+        return LIST_NONE;
+    }
+    return frame;
+}
+
+//tells the strategy about a pin of a page found in the pool. A page of a bulk ring pinned without bulk joins the pool.
+static void noteHit(struct queuePool *queuePool, int frame, bool bulk) {
+    lockStrategy(queuePool);
+    if (__atomic_load_n(&queuePool->ringFrames[frame], __ATOMIC_RELAXED)) {
+        if (!bulk) { //in demand beyond the bulk operation
+            __atomic_store_n(&queuePool->ringFrames[frame], FALSE, __ATOMIC_RELAXED);
+            strategyAdmit(queuePool, frame);
+        }
+    } else if (__atomic_load_n(&queuePool->prefetched[frame], __ATOMIC_RELAXED) //first request for a page brought in by read-ahead
+            && __atomic_exchange_n(&queuePool->prefetched[frame], FALSE, __ATOMIC_RELAXED)) {
+        strategyFirstUse(queuePool, frame);
+    } else {
+        strategyHit(queuePool, frame);
+    }
+    unlockStrategy(queuePool);
+}
+
+//rebalances the frame budget of a shard once enough misses went by
+static inline void checkFrameBudget(struct queuePool *queuePool) {
+    if (queuePool->share != NULL && __atomic_load_n(&queuePool->share->budget->misses, __ATOMIC_RELAXED) >= BUDGET_REBALANCE_MISSES) {
+        rebalanceFrameBudget(queuePool->share->budget);
+    }
+}
+
+//pins pageNum if it is in the pool and tells the strategy. Returns its frame, or LIST_NONE with *status
+//RC_OK when the page is not in the pool and RC_READ_NON_EXISTING_PAGE when its read failed.
+static int pinHit(struct queuePool *queuePool, const PageNumber pageNum, bool bulk, RC *status) {
+    int frame = pinResidentFrame(queuePool, pageNum);
+
+    *status = RC_OK;
+    if (frame == LIST_NONE) {
+        return LIST_NONE;
+    }
+    if (!waitForFrame(queuePool, frame, pageNum)) {
+        unpinFrame(queuePool, frame); //the read of the page failed
+        *status = RC_READ_NON_EXISTING_PAGE;
+        return LIST_NONE;
+    }
+    noteHit(queuePool, frame, bulk);
+    return frame;
+}
+
 RC pinPage(BM_BufferPool * const bm, BM_PageHandle * const page, const PageNumber pageNum) {
 
-    if (bm->strategy == RS_LRU) {
-        return pinPageWithLRU(bm, page, pageNum);
-    } else if (bm->strategy == RS_FIFO) {
-        return pinPageWithFIFO(bm, page, pageNum);
+    struct bufferPool *pool = bm->mgmtData;
+    struct queuePool *queuePool = shardOf(pool, pageNum);
+    RC status = RC_OK;
+    int frame;
+
+    while (1) {
+        frame = pinHit(queuePool, pageNum, FALSE, &status);
+        if (frame != LIST_NONE) { //page is already in the buffer pool
+            break;
+        }
+        if (status != RC_OK) {
+            return status;
+        }
+        frame = pinMissingPage(queuePool, pageNum, NULL, &status);
+        if (frame != LIST_NONE) {
+            break;
+        }
+        if (status != RC_OK) {
+            return status;
+        }
+    }
+    page->pageNum = pageNum;
+    page->data = frameDataOf(queuePool, frame);
+    readAheadAfterPin(pool, pageNum);
+    checkFrameBudget(queuePool);
+    return RC_OK;
+}
+
+/**********************************************************************************
+ * Asynchronous pins
+ *
+ * pinPageAsync does the part of a pin that needs no wait for the page: a page
+ * in the pool is pinned at once, a missing page gets a frame, is filed under
+ * it marked ioInProgress and its read goes to the storage manager
+ * (readBlockAsync). A dirty victim is still written back before pinPageAsync
+ * returns, the background writer keeps victims clean. The read's completion
+ * ends the frame's I/O as a synchronous read does, so waitPin, and any thread
+ * pinning the page meanwhile, simply waits for the frame.
+ ***********************************************************************************/
+
+struct BM_PinRequest {
+    struct queuePool *queuePool;
+    int frame;
+    PageNumber pageNum;
+};
+
+//completion of the read started by startFrameRead, the request may be gone once the frame's I/O ended
+static void frameReadDone(void *context, RC rc) {
+    BM_PinRequest *request = context;
+    struct queuePool *queuePool = request->queuePool;
+    int frame = request->frame;
+
+    if (rc == RC_OK) {
+        __atomic_add_fetch(&queuePool->numRead, 1, __ATOMIC_RELAXED);
     } else {
-        return NO_SUCH_METHOD;
+        forgetFramePage(queuePool, frame, request->pageNum);
+    }
+    endFrameIO(queuePool, frame);
+}
+
+//starts the read of a frame filed for request->pageNum. When it can't be started the frame is left empty and unpinned.
+static void startFrameRead(struct queuePool *queuePool, int frame, BM_PinRequest *request, RC *status) {
+    request->frame = frame;
+    *status = ensureCapacity(request->pageNum + 1, queuePool->fileHandle); //pages 0 to pageNum have to exist
+    if (*status == RC_OK) {
+        *status = readBlockAsync(request->pageNum, queuePool->fileHandle, frameDataOf(queuePool, frame), frameReadDone, request);
+    } else {
+        *status = RC_ENSURE_CAP_ERROR;
+    }
+    if (*status != RC_OK) {
+        forgetFramePage(queuePool, frame, request->pageNum);
+        endFrameIO(queuePool, frame);
+        unpinFrame(queuePool, frame);
+    }
+}
+
+/**********************************************************************************
+ * Function Name: pinPageAsync
+ *
+ * Description:
+ *      starts pinning pageNum and returns before the page is read, so a
+ *      caller can have many misses in flight. The pin is finished by waitPin,
+ *      which every request has to go through; pinReady tells whether waitPin
+ *      would wait. Async pins don't trigger read-ahead.
+ *
+ * Return:
+ *      RC_OK with *request set, else the error of pinPage with *request NULL
+ *
+ ***********************************************************************************/
+
+RC pinPageAsync(BM_BufferPool * const bm, const PageNumber pageNum, BM_PinRequest **request) {
+
+    BM_PinRequest *pin = malloc(sizeof (BM_PinRequest));
+    struct queuePool *queuePool = shardOf(bm->mgmtData, pageNum);
+    RC status = RC_OK;
+
+    pin->queuePool = queuePool;
+    pin->pageNum = pageNum;
+    *request = NULL;
+    while (1) {
+        int frame = pinResidentFrame(queuePool, pageNum);
+        if (frame != LIST_NONE) { //its read, if one is under way, is waited for by waitPin
+            pin->frame = frame;
+            noteHit(queuePool, frame, FALSE);
+            break;
+        }
+        if (pinMissingPage(queuePool, pageNum, pin, &status) != LIST_NONE) { //sets pin->frame
+            break;
+        }
+        if (status != RC_OK) {
+            free(pin);
+            return status;
+        }
     }
+    checkFrameBudget(queuePool);
+    *request = pin;
+    return RC_OK;
+}
 
+bool pinReady(BM_PinRequest *request) {
+    return !__atomic_load_n(&request->queuePool->ioInProgress[request->frame], __ATOMIC_ACQUIRE);
 }
 
+//finishes an asynchronous pin: waits for the page, fills page and frees the request. Returns as pinPage.
+RC waitPin(BM_PinRequest *request, BM_PageHandle * const page) {
+    struct queuePool *queuePool = request->queuePool;
+    int frame = request->frame;
+    PageNumber pageNum = request->pageNum;
+    bool loaded = waitForFrame(queuePool, frame, pageNum);
+
+    free(request);
+    if (!loaded) {
+        unpinFrame(queuePool, frame); //the read of the page failed
+        return RC_READ_NON_EXISTING_PAGE;
+    }
+    page->pageNum = pageNum;
+    page->data = frameDataOf(queuePool, frame);
+    return RC_OK;
+}
+
+
+/**********************************************************************************
+ * Batch pins
+ *
+ * pinPages pins a set of pages known ahead of time in three passes: the pages
+ * in the pool are pinned first, the misses are sorted by page number, and
+ * every run of consecutive missing pages in one shard is loaded with one
+ * vectored read (readBlocks) into frames taken under one hold of the shard's
+ * lock. A page another thread loads meanwhile ends its run and is pinned on
+ * its own.
+ ***********************************************************************************/
+
+struct batchMiss {
+    PageNumber pageNum;
+    int handle; //index into the handles of pinPages
+};
+
+static int compareBatchMisses(const void *a, const void *b) {
+    const struct batchMiss *ma = a, *mb = b;
+    if (ma->pageNum != mb->pageNum) {
+        return (ma->pageNum > mb->pageNum) - (ma->pageNum < mb->pageNum);
+    }
+    return (ma->handle > mb->handle) - (ma->handle < mb->handle);
+}
+
+//loads the count pages from firstPage, all of them in queuePool, into frames pinned once each. Returns
+//the pages loaded, the first ones of the run, with *status RC_OK, or 0 with the error in *status.
+static int pinMissingRun(struct queuePool *queuePool, PageNumber firstPage, int count, int *frames, RC *status) {
+    SM_PageHandle *pages = malloc(count * sizeof (SM_PageHandle));
+    int taken, i;
+
+    *status = RC_OK;
+    if (ensureCapacity(firstPage + count, queuePool->fileHandle) != RC_OK) {
+        free(pages);
+        *status = RC_ENSURE_CAP_ERROR;
+        return 0;
+    }
+    lockStrategy(queuePool);
+    for (taken = 0; taken < count; taken++) {
+        strategyMiss(queuePool, firstPage + taken);
+        budgetMiss(queuePool, firstPage + taken);
+        int frame = takeFrame(queuePool, FALSE, TRUE, status);
+        if (frame == LIST_NONE) {
+            break;
+        }
+        bool filed = fileFrame(queuePool, frame, firstPage + taken, FALSE);
+        if (!filed) { //another thread loaded the page meanwhile
+            unpinFrame(queuePool, frame);
+        }
+        strategyAdmit(queuePool, frame);
+        if (!filed) {
+            break;
+        }
+        frames[taken] = frame;
+        pages[taken] = frameDataOf(queuePool, frame);
+    }
+    unlockStrategy(queuePool);
+
+    if (*status == RC_OK && taken > 0 && readBlocks(firstPage, taken, queuePool->fileHandle, pages) != RC_OK) {
+        *status = RC_READ_NON_EXISTING_PAGE;
+    }
+    if (*status != RC_OK && taken > 0) { //threads waiting for the pages find the frames empty
+        lockStrategy(queuePool);
+        for (i = 0; i < taken; i++) {
+            pthread_mutex_t *lock = pageTableLock(queuePool->pageTable, firstPage + i);
+            pageTableRemove(queuePool->pageTable, firstPage + i, frames[i]);
+            __atomic_store_n(&queuePool->pageNumbers[frames[i]], NO_PAGE, __ATOMIC_RELEASE);
+            pthread_mutex_unlock(lock);
+        }
+        unlockStrategy(queuePool);
+    }
+    for (i = 0; i < taken; i++) {
+        endFrameIO(queuePool, frames[i]);
+        if (*status != RC_OK) {
+            unpinFrame(queuePool, frames[i]);
+        }
+    }
+    free(pages);
+    if (*status != RC_OK) {
+        return 0;
+    }
+    __atomic_add_fetch(&queuePool->numRead, taken, __ATOMIC_RELAXED);
+    return taken;
+}
+
+/**********************************************************************************
+ * Function Name: pinPages
+ *
+ * Description:
+ *      pins the n pages pageNums[i] into handles[i] like n calls of pinPage,
+ *      with one vectored read per run of consecutive missing pages. A page
+ *      asked for twice is pinned twice. Batch pins don't trigger read-ahead.
+ *
+ * Return:
+ *      RC_OK when every page is pinned, RC_INVALID_PAGE_COUNT for a negative n,
+ *      RC_MEMORY_ALLOCATION_ERROR, else the error of the first page that could
+ *      not be pinned, with none of the pages left pinned
+ *
+ ***********************************************************************************/
+
+RC pinPages(BM_BufferPool * const bm, BM_PageHandle * const handles, const PageNumber * const pageNums, int n) {
+
+    struct bufferPool *pool = bm->mgmtData;
+    if (n < 0) {
+        return RC_INVALID_PAGE_COUNT;
+    }
+    struct batchMiss *misses = malloc(n * sizeof (struct batchMiss));
+    int *frames = malloc(n * sizeof (int));
+    bool *pinned = calloc(n, sizeof (bool));
+    RC status = RC_OK;
+    int numMisses = 0, i, j;
+
+    if (n > 0 && (misses == NULL || frames == NULL || pinned == NULL)) {
+        free(misses);
+        free(frames);
+        free(pinned);
+        return RC_MEMORY_ALLOCATION_ERROR;
+    }
+
+    for (i = 0; i < n && status == RC_OK; i++) {
+        struct queuePool *queuePool = shardOf(pool, pageNums[i]);
+        int frame = pinHit(queuePool, pageNums[i], FALSE, &status);
+        if (frame != LIST_NONE) {
+            handles[i].pageNum = pageNums[i];
+            handles[i].data = frameDataOf(queuePool, frame);
+            pinned[i] = TRUE;
+        } else if (status == RC_OK) {
+            misses[numMisses].pageNum = pageNums[i];
+            misses[numMisses].handle = i;
+            numMisses++;
+        }
+    }
+    qsort(misses, numMisses, sizeof (struct batchMiss), compareBatchMisses);
+
+    for (i = 0; i < numMisses && status == RC_OK;) {
+        struct queuePool *queuePool = shardOf(pool, misses[i].pageNum);
+        PageNumber firstPage = misses[i].pageNum;
+        int count = 1, loaded;
+        for (j = i + 1; j < numMisses; j++) { //consecutive pages of one shard, a page asked for twice counts once
+            if (misses[j].pageNum == firstPage + count && shardOf(pool, misses[j].pageNum) == queuePool) {
+                count++;
+            } else if (misses[j].pageNum != firstPage + count - 1) {
+                break;
+            }
+        }
+        loaded = pinMissingRun(queuePool, firstPage, count, frames, &status);
+        for (; i < numMisses && misses[i].pageNum < firstPage + loaded; i++) {
+            int frame = frames[misses[i].pageNum - firstPage];
+            if (i > 0 && misses[i - 1].pageNum == misses[i].pageNum) { //the frame is pinned once for the first handle
+                __atomic_add_fetch(&queuePool->fixCounts[frame], 1, __ATOMIC_ACQUIRE);
+            }
+            handles[misses[i].handle].pageNum = misses[i].pageNum;
+            handles[misses[i].handle].data = frameDataOf(queuePool, frame);
+            pinned[misses[i].handle] = TRUE;
+        }
+        if (status == RC_OK && loaded < count) { //loaded by another thread meanwhile
+            PageNumber pageNum = misses[i].pageNum;
+            for (; i < numMisses && misses[i].pageNum == pageNum && status == RC_OK; i++) {
+                status = pinPage(bm, &handles[misses[i].handle], pageNum);
+                pinned[misses[i].handle] = (status == RC_OK);
+            }
+        }
+    }
+    if (status != RC_OK) { //all or nothing
+        for (i = 0; i < n; i++) {
+            if (pinned[i]) {
+                unpinPage(bm, &handles[i]);
+            }
+        }
+    } else {
+        checkFrameBudget(&pool->shards[0]);
+    }
+    free(misses);
+    free(frames);
+    free(pinned);
+    return status;
+}
+
+//unpins the n pages of handles, as pinned by pinPages. Returns RC_INVALID_PAGE_COUNT for a negative n,
+//else the error of the first page that was not pinned.
+RC unpinPages(BM_BufferPool * const bm, BM_PageHandle * const handles, int n) {
+    RC status = RC_OK;
+    int i;
+    if (n < 0) {
+        return RC_INVALID_PAGE_COUNT;
+    }
+    for (i = 0; i < n; i++) {
+        RC unpinned = unpinPage(bm, &handles[i]);
+        if (status == RC_OK) {
+            status = unpinned;
+        }
+    }
+    return status;
+}
+
+/**********************************************************************************
+ * Access strategies
+ *
+ * A bulk operation pins through an access strategy, like PostgreSQL's
+ * BufferAccessStrategy: the pages it loads go into a small private ring of
+ * frames that is recycled over and over instead of entering the pool's
+ * strategy, so a scan of the whole file displaces no more pages than the
+ * ring holds. Ring frames are out of the strategy (ringFrames). A ring page
+ * pinned by anyone else joins the pool's strategy and the ring takes a new
+ * frame for its slot. BULK_READ leaves a dirty ring frame to the pool rather
+ * than write it, BULK_WRITE writes it back itself and reuses it. A ring frame
+ * goes back to the pool, next in line for eviction, when its slot moves to
+ * another shard, when its shard runs out of frames and in freeAccessStrategy.
+ ***********************************************************************************/
+
+#define BULK_READ_RING_FRAMES 32
+#define BULK_WRITE_RING_FRAMES 128
+#define RING_MAX_SHARE 8 //a ring holds at most this part of the pool's frames
+
+struct ringSlot {
+    struct queuePool *shard; //NULL for a free slot
+    int frame;
+    PageNumber pageNum; //page the ring loaded into the frame
+};
+
+struct BM_AccessStrategy {
+    BM_AccessType type;
+    int numSlots;
+    int next; //slot recycled by the next miss
+    struct ringSlot *slots;
+};
+
+BM_AccessStrategy * getAccessStrategy(BM_BufferPool * const bm, BM_AccessType type) {
+    struct bufferPool *pool = bm->mgmtData;
+    if (type != BM_ACCESS_BULK_READ && type != BM_ACCESS_BULK_WRITE) {
+        return NULL;
+    }
+    BM_AccessStrategy *ring = malloc(sizeof (BM_AccessStrategy));
+    ring->type = type;
+    ring->numSlots = (type == BM_ACCESS_BULK_READ) ? BULK_READ_RING_FRAMES : BULK_WRITE_RING_FRAMES;
+    if (ring->numSlots > pool->totalNumFrames / RING_MAX_SHARE) {
+        ring->numSlots = (pool->totalNumFrames >= RING_MAX_SHARE) ? pool->totalNumFrames / RING_MAX_SHARE : 1;
+    }
+    ring->next = 0;
+    ring->slots = calloc(ring->numSlots, sizeof (struct ringSlot));
+    return ring;
+}
+
+//hands the frame of a slot to the pool, called with the lock of the slot's shard held
+static void releaseRingSlot(struct ringSlot *slot) {
+    struct queuePool *shard = slot->shard;
+    if (__atomic_load_n(&shard->pageNumbers[slot->frame], __ATOMIC_ACQUIRE) == slot->pageNum
+            && __atomic_exchange_n(&shard->ringFrames[slot->frame], FALSE, __ATOMIC_RELAXED)) {
+        strategyAdmitPrefetched(shard, slot->frame);
+    }
+    slot->shard = NULL;
+}
+
+void freeAccessStrategy(BM_AccessStrategy *strategy) {
+    int i;
+    if (strategy == NULL) {
+        return;
+    }
+    for (i = 0; i < strategy->numSlots; i++) {
+        struct queuePool *shard = strategy->slots[i].shard;
+        if (shard != NULL) {
+            lockStrategy(shard);
+            releaseRingSlot(&strategy->slots[i]);
+            unlockStrategy(shard);
+        }
+    }
+    free(strategy->slots);
+    free(strategy);
+}
+
+//evicts the page of a slot's frame to reuse the frame, called with the slot's shard locked. Returns
+//the frame, pinned and empty, or LIST_NONE: with *status RC_OK when the frame left the ring meanwhile,
+//is pinned or is dirty under BULK_READ, and is the pool's again.
+static int recycleRingSlot(BM_AccessStrategy *ring, struct ringSlot *slot, RC *status) {
+    struct queuePool *queuePool = slot->shard;
+    int frame = slot->frame;
+
+    slot->shard = NULL;
+    *status = RC_OK;
+    if (__atomic_load_n(&queuePool->pageNumbers[frame], __ATOMIC_ACQUIRE) != slot->pageNum
+            || !__atomic_exchange_n(&queuePool->ringFrames[frame], FALSE, __ATOMIC_RELAXED)) {
+        return LIST_NONE;
+    }
+    frame = evictVictim(queuePool, frame, ring->type == BM_ACCESS_BULK_READ, status); //back to the strategy unless evicted
+    return (frame == VICTIM_BUSY) ? LIST_NONE : frame;
+}
+
+//loads a page that was not found in the pool into the ring's next slot. Returns its frame, pinned, or
+//LIST_NONE: with *status RC_OK when another thread loaded the page meanwhile and the pin has to look again.
+static int pinRingMiss(BM_AccessStrategy *ring, struct queuePool *queuePool, const PageNumber pageNum, RC *status) {
+    struct ringSlot *slot = &ring->slots[ring->next];
+    int frame = LIST_NONE, i;
+
+    *status = RC_OK;
+    if (slot->shard != NULL && slot->shard != queuePool) { //one shard lock at a time
+        struct queuePool *shard = slot->shard;
+        lockStrategy(shard);
+        releaseRingSlot(slot);
+        unlockStrategy(shard);
+    }
+    lockStrategy(queuePool);
+    if (slot->shard != NULL) {
+        frame = recycleRingSlot(ring, slot, status);
+    }
+    if (frame == LIST_NONE && *status == RC_OK) {
+        frame = takeFrame(queuePool, FALSE, TRUE, status);
+        if (frame == LIST_NONE && *status == PAGE_NODE_NOT_FOUND) { //the ring took the frames of a small shard
+            for (i = 0; i < ring->numSlots; i++) {
+                if (ring->slots[i].shard == queuePool) {
+                    releaseRingSlot(&ring->slots[i]);
+                }
+            }
+            frame = takeFrame(queuePool, FALSE, TRUE, status);
+        }
+    }
+    if (frame == LIST_NONE) {
+        unlockStrategy(queuePool);
+        return LIST_NONE;
+    }
+    if (!fileFrame(queuePool, frame, pageNum, FALSE)) {
+        unpinFrame(queuePool, frame);
+        strategyAdmit(queuePool, frame); //the frame goes to the pool empty
+        unlockStrategy(queuePool);
+        *status = RC_OK;
+        return LIST_NONE;
+    }
+    __atomic_store_n(&queuePool->ringFrames[frame], TRUE, __ATOMIC_RELAXED);
+    slot->shard = queuePool;
+    slot->frame = frame;
+    slot->pageNum = pageNum;
+    ring->next = (ring->next + 1) % ring->numSlots;
+    unlockStrategy(queuePool);
+
+    *status = changeFrameContent(queuePool, frame, pageNum); //no pool lock during the read
+    endFrameIO(queuePool, frame);
+    if (*status != RC_OK) { //the empty frame goes to the pool
+        lockStrategy(queuePool);
+        if (__atomic_exchange_n(&queuePool->ringFrames[frame], FALSE, __ATOMIC_RELAXED)) {
+            strategyAdmit(queuePool, frame);
+        }
+        slot->shard = NULL;
+        unlockStrategy(queuePool);
+        unpinFrame(queuePool, frame);
+        return LIST_NONE;
+    }
+    return frame;
+}
+
+/**********************************************************************************
+ * Function Name: pinPageWithStrategy
+ *
+ * Description:
+ *      pins a page like pinPage, a page that is not in the pool is loaded into
+ *      the ring of the access strategy. Pages already in the pool are hits as
+ *      usual. Ring pins don't trigger read-ahead.
+ *
+ * Return:
+ *      as pinPage
+ *
+ ***********************************************************************************/
+
+RC pinPageWithStrategy(BM_BufferPool * const bm, BM_PageHandle * const page, const PageNumber pageNum, BM_AccessStrategy *strategy) {
+
+    struct queuePool *queuePool = shardOf(bm->mgmtData, pageNum);
+    RC status = RC_OK;
+    int frame;
+
+    if (strategy == NULL) {
+        return pinPage(bm, page, pageNum);
+    }
+    while (1) {
+        frame = pinHit(queuePool, pageNum, TRUE, &status);
+        if (frame != LIST_NONE) {
+            break;
+        }
+        if (status != RC_OK) {
+            return status;
+        }
+        frame = pinRingMiss(strategy, queuePool, pageNum, &status);
+        if (frame != LIST_NONE) {
+            break;
+        }
+        if (status != RC_OK) {
+            return status;
+        }
+    }
+    page->pageNum = pageNum;
+    page->data = frameDataOf(queuePool, frame);
+    return RC_OK;
+}
 
 RC markDirty(BM_BufferPool * const bm, BM_PageHandle * const page) {
 
-    struct queuePool *queuePool = bm->mgmtData;
-    struct DLnode *temp = findTheNode(queuePool, page->pageNum); //finding the address of the node in the buffer pool
-    if (temp != NULL) {
-        temp->dirty = 1;  //marking page as dirty of a frame node
-        bm->mgmtData = queuePool;
-        return RC_OK;
+    struct bufferPool *pool = bm->mgmtData;
+    struct queuePool *queuePool = shardOf(pool, page->pageNum);
+    int frame = findTheFrame(queuePool, page->pageNum); //finding the frame of the page in the buffer pool
+    if (frame == LIST_NONE) {
+        return PAGE_NODE_NOT_FOUND;
     }
-    return PAGE_NODE_NOT_FOUND;
+    if (latchHeldShared(queuePool, frame)) { //readers are looking at the page, changing it needs the exclusive latch
+        return RC_PAGE_LATCHED_SHARED;
+    }
+    if (markFrameDirty(queuePool, frame) //marking page as dirty
+            && __atomic_load_n(&queuePool->dirtyFrames, __ATOMIC_RELAXED) == __atomic_load_n(&queuePool->writerHighWater, __ATOMIC_RELAXED)) {
+        wakeBackgroundWriter(pool);
+    }
+    return RC_OK;
 }
 
 
 RC unpinPage(BM_BufferPool * const bm, BM_PageHandle * const page) {
 
-    struct queuePool *queuePool = bm->mgmtData;
-
-    struct DLnode *temp = findTheNode(queuePool, page->pageNum);
-    if (temp != NULL && temp->fixcount > 0) {
-        temp->fixcount = temp->fixcount - 1; //once the page is unpinned we are decrementing the fix count
-        bm->mgmtData = queuePool;
-        return RC_OK;
+    struct queuePool *queuePool = shardOf(bm->mgmtData, page->pageNum);
+    int frame = findTheFrame(queuePool, page->pageNum);
+    if (frame == LIST_NONE) {
+        return PAGE_NODE_NOT_FOUND;
     }
-    return PAGE_NODE_NOT_FOUND;
+    int fixCount = fixCountOf(queuePool, frame);
+    do { //once the page is unpinned we are decrementing the fix count
+        if (fixCount == 0) {
+            return PAGE_NODE_NOT_FOUND;
+        }
+    } while (!__atomic_compare_exchange_n(&queuePool->fixCounts[frame], &fixCount, fixCount - 1, TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return RC_OK;
 }
 
 //forcePage should write the current content of the page back to the page file on disk.
 RC forcePage(BM_BufferPool * const bm, BM_PageHandle * const page) {
 
-    struct queuePool *queuePool = bm->mgmtData;
-    SM_FileHandle fhandle;
-    if (openPageFile((char *) (bm->pageFile), &fhandle) != RC_OK) {
-        return RC_FILE_NOT_FOUND;
+    struct queuePool *queuePool = shardOf(bm->mgmtData, page->pageNum);
+    RC status = RC_OK;
+
+    int frame = pinResidentFrame(queuePool, page->pageNum); //the frame can't be evicted during the write
+    if (frame == LIST_NONE) {
+        return RC_NON_EXISTING_PAGE_IN_FRAME;
     }
-    struct DLnode *temp = findTheNode(queuePool, page->pageNum);
-    if (temp != NULL) {
-        if (writeBlock(temp->pageNumber, &fhandle, temp->data) != RC_OK) { //writing the data of the node back to the disk
-            return RC_WRITE_FAILED; 
-        }
+    if (!waitForFrame(queuePool, frame, page->pageNum)) {
+        unpinFrame(queuePool, frame);
+        return RC_NON_EXISTING_PAGE_IN_FRAME;
+    }
+    SM_PageHandle data = frameDataOf(queuePool, frame);
+    unsigned int version;
+    bool claimed = beginWriteBack(queuePool, frame, &version); //a clean page is written all the same
+    if (writeBlocks(1, queuePool->fileHandle, &page->pageNum, &data) != RC_OK) { //writing the data of the frame back to the disk
+        status = RC_WRITE_FAILED; 
     } else {
+        __atomic_add_fetch(&queuePool->numWrite, 1, __ATOMIC_RELAXED);
+    }
+    if (claimed) {
+        endWriteBack(queuePool, frame, version, status == RC_OK);
+    }
+    unpinFrame(queuePool, frame);
+    return status;
+}
+
+
+
+/**********************************************************************************
+ * Page latches
+ *
+ * pinPage only keeps a page resident. Threads that read a page while others
+ * may change it latch the page after pinning it: shared to read, exclusive to
+ * change it, and release the latch before unpinning. The frame is found from
+ * the handle's data pointer, so latching takes no lock of the pool.
+ *
+ * Readers of a few hot pages can skip the pin and the latch altogether: an
+ * optimistic read records the version of the page's frame, reads the frame
+ * and then checks the version is unchanged. Readers then only read the
+ * frame's cache lines and never write them. What they read may be changing
+ * under them, it holds only once validateOptimisticRead agreed.
+ ***********************************************************************************/
+
+//frame of the shard a data pointer points into, LIST_NONE when it points elsewhere
+static int frameOfData(struct queuePool *queuePool, char *data) {
+    ptrdiff_t offset = data - queuePool->frameData;
+    if (data == NULL || offset < 0 || offset >= (ptrdiff_t) queuePool->totalNumFrames * queuePool->pageSize) {
+        return LIST_NONE;
+    }
+    return offset / queuePool->pageSize;
+}
+
+//frame of the shard a pinned handle points into, LIST_NONE for a handle that isn't pinned
+static int frameOfHandle(struct queuePool *queuePool, BM_PageHandle * const page) {
+    int frame = frameOfData(queuePool, page->data);
+    if (frame == LIST_NONE) {
+        return LIST_NONE;
+    }
+    if (fixCountOf(queuePool, frame) == 0 || queuePool->pageNumbers[frame] != page->pageNum) {
+        return LIST_NONE;
+    }
+    return frame;
+}
+
+/**********************************************************************************
+ * Function Name: latchPage
+ *
+ * Description:
+ *      latches the content of a page pinned by the caller, BM_LATCH_SHARED
+ *      along with other readers, BM_LATCH_EXCLUSIVE alone. Waits until the
+ *      latch can be had. The latch isn't reentrant and can't be upgraded.
+ *
+ * Return:
+ *      RC_OK, or PAGE_NODE_NOT_FOUND when the handle isn't pinned
+ *
+ ***********************************************************************************/
+
+RC latchPage(BM_BufferPool * const bm, BM_PageHandle * const page, BM_LatchMode mode) {
+
+    struct queuePool *queuePool = shardOf(bm->mgmtData, page->pageNum);
+    int frame = frameOfHandle(queuePool, page);
+    if (frame == LIST_NONE) {
+        return PAGE_NODE_NOT_FOUND;
+    }
+    if (mode == BM_LATCH_EXCLUSIVE) {
+        latchExclusive(&queuePool->pageLatches[frame]);
+    } else {
+        latchShared(&queuePool->pageLatches[frame]);
+    }
+    return RC_OK;
+}
+
+RC unlatchPage(BM_BufferPool * const bm, BM_PageHandle * const page) {
+
+    struct queuePool *queuePool = shardOf(bm->mgmtData, page->pageNum);
+    int frame = frameOfHandle(queuePool, page);
+    if (frame == LIST_NONE) {
+        return PAGE_NODE_NOT_FOUND;
+    }
+    latchRelease(&queuePool->pageLatches[frame]);
+    return RC_OK;
+}
+
+/**********************************************************************************
+ * Function Name: beginOptimisticRead
+ *
+ * Description:
+ *      starts an optimistic read of pageNum: points page at the frame holding
+ *      it and records the frame's version, without pinning or latching. A
+ *      handle left from an earlier read of the same page is used as a hint,
+ *      so a page read again and again costs no page table lookup.
+ *
+ * Return:
+ *      RC_OK, or RC_NON_EXISTING_PAGE_IN_FRAME when the page isn't in the pool,
+ *      is being read in or is latched by a writer: the caller pins it instead
+ *
+ ***********************************************************************************/
+
+RC beginOptimisticRead(BM_BufferPool * const bm, BM_PageHandle * const page, const PageNumber pageNum, unsigned int *version) {
+
+    struct queuePool *queuePool = shardOf(bm->mgmtData, pageNum);
+    int frame = (page->pageNum == pageNum) ? frameOfData(queuePool, page->data) : LIST_NONE;
+    if (frame == LIST_NONE || __atomic_load_n(&queuePool->pageNumbers[frame], __ATOMIC_RELAXED) != pageNum) {
+        frame = findTheFrame(queuePool, pageNum);
+        if (frame == LIST_NONE) {
+            return RC_NON_EXISTING_PAGE_IN_FRAME;
+        }
+    }
+    *version = __atomic_load_n(&queuePool->pageLatches[frame].version, __ATOMIC_ACQUIRE);
+    if ((*version & 1) //a writer is at work
+            || __atomic_load_n(&queuePool->pageNumbers[frame], __ATOMIC_ACQUIRE) != pageNum //the frame changed its page
+            || __atomic_load_n(&queuePool->ioInProgress[frame], __ATOMIC_ACQUIRE)) { //the page is still being read in
         return RC_NON_EXISTING_PAGE_IN_FRAME;
     }
-    queuePool->numWrite = queuePool->numWrite + 1; 
-    bm->mgmtData = queuePool;
-    closePageFile(&fhandle);
+    page->pageNum = pageNum;
+    page->data = frameDataOf(queuePool, frame);
+    return RC_OK;
+}
+
+//TRUE when nothing changed the page since beginOptimisticRead returned version, what was read holds
+bool validateOptimisticRead(BM_BufferPool * const bm, BM_PageHandle * const page, unsigned int version) {
+
+    struct queuePool *queuePool = shardOf(bm->mgmtData, page->pageNum);
+    int frame = frameOfData(queuePool, page->data);
+    if (frame == LIST_NONE) {
+        return FALSE;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE); //the reads of the page happen before the version is read again
+    return __atomic_load_n(&queuePool->pageLatches[frame].version, __ATOMIC_RELAXED) == version;
+}
+
+
+/**********************************************************************************
+ * Frame budget, see replacementStrategies.c
+ *
+ * Rebalancing takes the budget lock and then the pool lock of one shard at a
+ * time, the order pins never see since they hold no budget lock.
+ ***********************************************************************************/
+
+/**********************************************************************************
+ * Function Name: setFrameBudget
+ *
+ * Description:
+ *      sets the number of frames the pools opened from now on share, 0 or less
+ *      for pools with frames of their own. A pool opened with the budget on
+ *      holds up to numPages frames and at least SHARD_MIN_FRAMES per shard.
+ *
+ * Return:
+ *      RC_OK, RC_FRAME_BUDGET_IN_USE while pools of the current budget are open
+ *
+ ***********************************************************************************/
+
+RC setFrameBudget(int maxFrames) {
+    if (frameBudget != NULL) {
+        pthread_mutex_lock(&frameBudget->lock);
+        bool inUse = frameBudget->shares != NULL;
+        pthread_mutex_unlock(&frameBudget->lock);
+        if (inUse) {
+            return RC_FRAME_BUDGET_IN_USE;
+        }
+        pthread_mutex_destroy(&frameBudget->lock);
+        free(frameBudget);
+        frameBudget = NULL;
+    }
+    if (maxFrames > 0) {
+        frameBudget = malloc(sizeof (struct frameBudget));
+        frameBudget->maxFrames = maxFrames;
+        frameBudget->committedFrames = 0;
+        frameBudget->misses = 0;
+        frameBudget->shares = NULL;
+        pthread_mutex_init(&frameBudget->lock, NULL);
+    }
+    return RC_OK;
+}
+
+//parks one unpinned frame of a shard, called with its pool lock held: the page is evicted, the frame
+//leaves the strategy and its memory goes back to the system. FALSE when every frame is pinned.
+static bool parkFrame(struct queuePool *queuePool) {
+    struct budgetShare *share = queuePool->share;
+    RC status;
+    int frame = takeFrame(queuePool, FALSE, FALSE, &status);
+
+    if (frame == LIST_NONE) {
+        return FALSE;
+    }
+    madvise(frameDataOf(queuePool, frame), queuePool->pageSize, MADV_DONTNEED);
+    share->parked[frame] = TRUE;
+    share->parkedFrames[share->numParked++] = frame;
+    releaseFrame(share);
+    unpinFrame(queuePool, frame);
+    return TRUE;
+}
+
+//parks up to count frames of a shard above its minimum and keeps it from growing back. Returns the frames parked.
+static int shrinkShare(struct budgetShare *share, int count) {
+    int parked = 0;
+    lockStrategy(share->shard);
+    while (parked < count && share->charged > share->minFrames && parkFrame(share->shard)) {
+        parked++;
+    }
+    __atomic_store_n(&share->target, share->charged, __ATOMIC_RELAXED);
+    unlockStrategy(share->shard);
+    return parked;
+}
+
+//adds the shards of a new pool to the budget, parking frames of the others for their minimums
+static RC joinFrameBudget(struct bufferPool *pool) {
+    struct frameBudget *budget = pool->shards[0].share->budget;
+    struct budgetShare *share;
+    int needed = 0, s;
+
+    for (s = 0; s < pool->numShards; s++) {
+        needed += pool->shards[s].share->minFrames;
+    }
+    pthread_mutex_lock(&budget->lock);
+    __atomic_add_fetch(&budget->committedFrames, needed, __ATOMIC_RELAXED);
+    while (__atomic_load_n(&budget->committedFrames, __ATOMIC_RELAXED) > budget->maxFrames) {
+        struct budgetShare *donor = NULL; //the share with most frames above its minimum
+        for (share = budget->shares; share != NULL; share = share->next) {
+            if (donor == NULL || share->charged - share->minFrames > donor->charged - donor->minFrames) {
+                donor = share;
+            }
+        }
+        if (donor == NULL || donor->charged <= donor->minFrames
+                || shrinkShare(donor, __atomic_load_n(&budget->committedFrames, __ATOMIC_RELAXED) - budget->maxFrames) == 0) {
+            __atomic_sub_fetch(&budget->committedFrames, needed, __ATOMIC_RELAXED);
+            pthread_mutex_unlock(&budget->lock);
+            return RC_FRAME_BUDGET_EXCEEDED;
+        }
+    }
+    for (s = 0; s < pool->numShards; s++) {
+        pool->shards[s].share->next = budget->shares;
+        budget->shares = pool->shards[s].share;
+    }
+    pthread_mutex_unlock(&budget->lock);
+    return RC_OK;
+}
+
+//takes the shards of a pool out of its budget and returns their frames, a pool that failed to join has none
+static void leaveFrameBudget(struct bufferPool *pool) {
+    struct frameBudget *budget = pool->shards[0].share->budget;
+    struct budgetShare **link;
+
+    pthread_mutex_lock(&budget->lock);
+    for (link = &budget->shares; *link != NULL;) {
+        struct budgetShare *share = *link;
+        if (share->shard >= pool->shards && share->shard < pool->shards + pool->numShards) {
+            *link = share->next;
+            __atomic_sub_fetch(&budget->committedFrames, (share->charged > share->minFrames) ? share->charged : share->minFrames, __ATOMIC_RELAXED);
+        } else {
+            link = &share->next;
+        }
+    }
+    pthread_mutex_unlock(&budget->lock);
+}
+
+/**********************************************************************************
+ * Function Name: rebalanceFrameBudget
+ *
+ * Description:
+ *      moves frames to the shard whose ghosts were hit most since the last
+ *      rebalance, from the shard whose ghosts were hit least, when the budget
+ *      has no room left for it to grow. The frames parked in the donor are a
+ *      step of its cap / BUDGET_STEP_DIVISOR, and every other shard is held at
+ *      the frames it has, so the receiver gets what was freed. A pin that
+ *      finds another thread rebalancing goes on without waiting.
+ *
+ * Return:
+ *      void
+ *
+ ***********************************************************************************/
+
+static void rebalanceFrameBudget(struct frameBudget *budget) {
+    struct budgetShare *share, *receiver = NULL, *donor = NULL;
+
+    if (pthread_mutex_trylock(&budget->lock) != 0) {
+        return;
+    }
+    if (__atomic_load_n(&budget->misses, __ATOMIC_RELAXED) < BUDGET_REBALANCE_MISSES) {
+        pthread_mutex_unlock(&budget->lock); //rebalanced by the thread before
+        return;
+    }
+    __atomic_store_n(&budget->misses, 0, __ATOMIC_RELAXED);
+    for (share = budget->shares; share != NULL; share = share->next) {
+        share->score = __atomic_exchange_n(&share->ghostHits, 0, __ATOMIC_RELAXED);
+        int charged = __atomic_load_n(&share->charged, __ATOMIC_RELAXED);
+        if (share->score > 0 && charged < share->shard->totalNumFrames && (receiver == NULL || share->score > receiver->score)) {
+            receiver = share;
+        }
+    }
+    for (share = budget->shares; share != NULL; share = share->next) {
+        if (share != receiver && __atomic_load_n(&share->charged, __ATOMIC_RELAXED) > share->minFrames
+                && (donor == NULL || share->score < donor->score)) {
+            donor = share;
+        }
+    }
+
+    if (receiver != NULL) {
+        int step = (donor != NULL) ? donor->shard->totalNumFrames / BUDGET_STEP_DIVISOR : 0;
+        int room = budget->maxFrames - __atomic_load_n(&budget->committedFrames, __ATOMIC_RELAXED);
+        step = (step > 1) ? step : 1;
+        if (room < step) { //full: the other shards stop growing, the donor gives what is missing
+            for (share = budget->shares; share != NULL; share = share->next) {
+                if (share != receiver && __atomic_load_n(&share->target, __ATOMIC_RELAXED) > __atomic_load_n(&share->charged, __ATOMIC_RELAXED)) {
+                    __atomic_store_n(&share->target, __atomic_load_n(&share->charged, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+                }
+            }
+            if (donor != NULL && donor->score < receiver->score) {
+                room += shrinkShare(donor, step - room);
+            }
+        }
+        int target = __atomic_load_n(&receiver->charged, __ATOMIC_RELAXED) + ((room > 0) ? room : 0);
+        target = (target < receiver->shard->totalNumFrames) ? target : receiver->shard->totalNumFrames;
+        if (target > __atomic_load_n(&receiver->target, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&receiver->target, target, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&budget->lock);
+}
+
+
+/**********************************************************************************
+ * Sequential read-ahead
+ *
+ * Once setReadAhead turned it on, every successful pin is checked against the
+ * pin before it. After READ_AHEAD_MIN_RUN pins in a row each asked for the
+ * page after the previous one, the next READ_AHEAD_INITIAL pages are read
+ * ahead as one vectored read (readBlocks). When the scan reaches the first
+ * page of that window the following window is read, twice as large, up to
+ * maxPages: like the Linux readahead window the reader stays a window behind
+ * the I/O and the window grows while the pattern holds. Any other page ends
+ * the run and the window starts over.
+ *
+ * Read-ahead only takes free frames and clean frames next in line for
+ * eviction, it never writes a page back to make room. The pages enter the
+ * strategy at low priority (strategyAdmitPrefetched) and count as loaded
+ * only once pinned (strategyFirstUse), so a scan can't displace the hot set.
+ *
+ * The window state belongs to the thread holding readAhead.lock. A pin that
+ * finds it taken skips read-ahead rather than wait. In a sharded pool the
+ * window is read one shard extent at a time, into frames of that shard.
+ ***********************************************************************************/
+
+#define READ_AHEAD_MIN_RUN 2
+#define READ_AHEAD_INITIAL 4
+
+//number of frames of a shard read-ahead may take: the frames it may grow by, then the clean unpinned frames at the
+//eviction end up to the first dirty one. The eviction order is best effort, see strategyEvictionOrder.
+//Called with the shard's pool lock held.
+static int readAheadFrameBudget(struct queuePool *queuePool, struct readAhead *readAhead, int wanted) {
+    int budget = growableFrames(queuePool);
+    int candidates, i;
+
+    if (budget >= wanted) {
+        return wanted;
+    }
+    //held pages read ahead earlier come first in the eviction order, up to two windows of them
+    candidates = strategyEvictionOrder(queuePool, readAhead->candidates, 2 * (wanted - budget + readAhead->maxPages));
+    for (i = 0; i < candidates && budget < wanted; i++) {
+        int frame = readAhead->candidates[i];
+        if (fixCountOf(queuePool, frame) > 0) {
+            continue;
+        }
+        if (frameIsDirty(queuePool, frame)) {
+            break;
+        }
+        budget++;
+    }
+    return budget;
+}
+
+//reads the count pages from firstPage, all of them in one shard and not resident, into frames of
+//the shard. Returns the pages read.
+static int readAheadShardRun(struct queuePool *queuePool, struct readAhead *readAhead, PageNumber firstPage, int count) {
+    int *frames = readAhead->candidates; //the budget is known, the scratch is free again
+    SM_PageHandle *pages;
+    RC status;
+    int taken, i;
+
+    lockStrategy(queuePool);
+    count = readAheadFrameBudget(queuePool, readAhead, count);
+    pages = malloc(count * sizeof (SM_PageHandle));
+    for (taken = 0; taken < count; taken++) {
+        int frame = takeFrame(queuePool, TRUE, TRUE, &status); //pinned, so CLOCK can't hand it out twice
+        if (frame == LIST_NONE) {
+            break;
+        }
+        if (!fileFrame(queuePool, frame, firstPage + taken, TRUE)) { //another thread loaded the page meanwhile
+            unpinFrame(queuePool, frame);
+            strategyAdmitPrefetched(queuePool, frame);
+            break;
+        }
+        strategyAdmitPrefetched(queuePool, frame);
+        frames[taken] = frame;
+        pages[taken] = frameDataOf(queuePool, frame);
+    }
+    unlockStrategy(queuePool);
+
+    bool loaded = (taken > 0 && readBlocks(firstPage, taken, queuePool->fileHandle, pages) == RC_OK);
+    if (!loaded && taken > 0) { //a failed read leaves the frames empty
+        lockStrategy(queuePool);
+        for (i = 0; i < taken; i++) {
+            pthread_mutex_t *lock = pageTableLock(queuePool->pageTable, firstPage + i);
+            pageTableRemove(queuePool->pageTable, firstPage + i, frames[i]);
+            __atomic_store_n(&queuePool->pageNumbers[frames[i]], NO_PAGE, __ATOMIC_RELEASE);
+            __atomic_store_n(&queuePool->prefetched[frames[i]], FALSE, __ATOMIC_RELAXED);
+            pthread_mutex_unlock(lock);
+        }
+        unlockStrategy(queuePool);
+    }
+    for (i = 0; i < taken; i++) {
+        endFrameIO(queuePool, frames[i]);
+        unpinFrame(queuePool, frames[i]);
+    }
+    free(pages);
+    if (!loaded) {
+        return 0;
+    }
+    __atomic_add_fetch(&queuePool->numRead, taken, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&queuePool->numReadAhead, taken, __ATOMIC_RELAXED);
+    return taken;
+}
+
+//pins the pages of [firstPage, endPage) read ahead and not used yet, adding their frames to readAhead.held
+static void holdPrefetched(struct bufferPool *pool, PageNumber firstPage, PageNumber endPage, int *held) {
+    PageNumber page;
+    for (page = firstPage; page < endPage; page++) {
+        struct queuePool *queuePool = shardOf(pool, page);
+        int frame = pinResidentFrame(queuePool, page);
+        if (frame == LIST_NONE) {
+            continue;
+        }
+        if (__atomic_load_n(&queuePool->prefetched[frame], __ATOMIC_RELAXED)) {
+            pool->readAhead.held[*held].shard = queuePool;
+            pool->readAhead.held[(*held)++].frame = frame;
+        } else {
+            unpinFrame(queuePool, frame);
+        }
+    }
+}
+
+static inline bool isResident(struct bufferPool *pool, const PageNumber pageNum) {
+    return findTheFrame(shardOf(pool, pageNum), pageNum) != LIST_NONE;
+}
+
+//reads the pages of [firstPage, endPage) that are not resident, runs of missing pages one read each,
+//a run never crosses a shard extent.
+//The pages read ahead earlier and not used yet sit at the eviction end as well, they are held
+//meanwhile so the window does not evict them. Returns the page the window ends at, before
+//endPage when it ran out of clean frames.
+static PageNumber readAheadWindow(struct bufferPool *pool, PageNumber firstPage, PageNumber endPage) {
+    PageNumber page = firstPage;
+    int held = 0, i;
+
+    if (endPage > __atomic_load_n(&pool->fileHandle.totalNumPages, __ATOMIC_ACQUIRE)) { //read-ahead never grows the file
+        endPage = pool->fileHandle.totalNumPages;
+    }
+    holdPrefetched(pool, pool->readAhead.lastPage + 1, firstPage, &held);
+    while (page < endPage) {
+        PageNumber runEnd;
+        if (isResident(pool, page)) {
+            holdPrefetched(pool, page, page + 1, &held);
+            page++;
+            continue;
+        }
+        PageNumber runLimit = endPage;
+        if (pool->numShards > 1 && runLimit > page - page % SHARD_EXTENT_PAGES + SHARD_EXTENT_PAGES) {
+            runLimit = page - page % SHARD_EXTENT_PAGES + SHARD_EXTENT_PAGES; //the next extent may be in another shard
+        }
+        for (runEnd = page + 1; runEnd < runLimit && !isResident(pool, runEnd); runEnd++) {
+        }
+        if (readAheadShardRun(shardOf(pool, page), &pool->readAhead, page, runEnd - page) < runEnd - page) {
+            break; //out of clean frames
+        }
+        holdPrefetched(pool, page, runEnd, &held); //so are the pages of this window
+        page = runEnd;
+    }
+    for (i = 0; i < held; i++) {
+        unpinFrame(pool->readAhead.held[i].shard, pool->readAhead.held[i].frame);
+    }
+    return page;
+}
+
+//called after every successful pin
+static void readAheadAfterPin(struct bufferPool *pool, const PageNumber pageNum) {
+    struct readAhead *readAhead = &pool->readAhead;
+    PageNumber firstPage;
+
+    if (__atomic_load_n(&readAhead->maxPages, __ATOMIC_RELAXED) == 0 || pthread_mutex_trylock(&readAhead->lock) != 0) {
+        return;
+    }
+    if (readAhead->maxPages == 0 || pageNum == readAhead->lastPage) {
+        pthread_mutex_unlock(&readAhead->lock);
+        return;
+    }
+    if (pageNum != readAhead->lastPage + 1) { //the run is broken
+        readAhead->lastPage = pageNum;
+        readAhead->run = 0;
+        readAhead->window = 0;
+        pthread_mutex_unlock(&readAhead->lock);
+        return;
+    }
+    readAhead->lastPage = pageNum;
+    readAhead->run++;
+    if (readAhead->window == 0 && readAhead->run >= READ_AHEAD_MIN_RUN) {
+        readAhead->window = (READ_AHEAD_INITIAL < readAhead->maxPages) ? READ_AHEAD_INITIAL : readAhead->maxPages;
+        firstPage = pageNum + 1;
+    } else if (readAhead->window > 0 && pageNum >= readAhead->windowStart) { //the scan caught up with the last window
+        readAhead->window = (2 * readAhead->window < readAhead->maxPages) ? 2 * readAhead->window : readAhead->maxPages;
+        firstPage = (readAhead->windowEnd > pageNum) ? readAhead->windowEnd : pageNum + 1;
+    } else {
+        pthread_mutex_unlock(&readAhead->lock);
+        return;
+    }
+    readAhead->windowStart = firstPage;
+    readAhead->windowEnd = readAheadWindow(pool, firstPage, firstPage + readAhead->window);
+    pthread_mutex_unlock(&readAhead->lock);
+}
+
+RC setReadAhead(BM_BufferPool * const bm, int maxPages) {
+    struct bufferPool *pool = bm->mgmtData;
+    int limit = pool->totalNumFrames / pool->numShards / 4; //a window never takes more than a quarter of a shard
+
+    maxPages = (maxPages < limit) ? maxPages : limit;
+    pthread_mutex_lock(&pool->readAhead.lock);
+    if (maxPages > 0 && pool->readAhead.candidates == NULL) {
+        pool->readAhead.candidates = malloc(pool->totalNumFrames * sizeof (int));
+        pool->readAhead.held = malloc(pool->totalNumFrames * sizeof (struct heldFrame));
+    }
+    __atomic_store_n(&pool->readAhead.maxPages, (maxPages > 0) ? maxPages : 0, __ATOMIC_RELAXED);
+    pool->readAhead.run = 0;
+    pool->readAhead.window = 0;
+    pthread_mutex_unlock(&pool->readAhead.lock);
     return RC_OK;
 }
 
 
 
+/**********************************************************************************
+ * Background writer
+ *
+ * An optional thread per pool that cleans dirty frames before they reach the
+ * eviction end, so a miss seldom has to write its victim back first. It wakes
+ * every intervalMs, or as soon as markDirty pushes the share of dirty frames
+ * of a shard to highWaterPercent. It then looks at the frames the strategy of
+ * each shard would evict next (strategyEvictionOrder) and writes up to
+ * maxBatch dirty unpinned ones as one batch. While a frame is being written
+ * the writer holds a pin on it, and no lock is held during the I/O.
+ ***********************************************************************************/
+
+#define WRITER_DEFAULT_INTERVAL_MS 100
+#define WRITER_DEFAULT_HIGH_WATER 10
+#define WRITER_DEFAULT_BATCH 64
+
+struct backgroundWriter {
+    pthread_t thread;
+    pthread_cond_t wake;
+    bool running;
+    BM_WriterParams params;
+    int *candidates; //eviction order scratch, one entry per frame
+    PageNumber *pageNums; //the batch being written
+    SM_PageHandle *pages;
+    int *frames;
+    unsigned int *versions; //of the frames' write-backs, see beginWriteBack
+};
+
+//called when markDirty reaches the high-water mark of a shard, writerHighWater, which is 0 while no writer runs
+static void wakeBackgroundWriter(struct bufferPool *pool) {
+    pthread_mutex_lock(&pool->writerLock);
+    if (pool->writer != NULL) {
+        pthread_cond_signal(&pool->writer->wake);
+    }
+    pthread_mutex_unlock(&pool->writerLock);
+}
+
+static bool aboveHighWater(struct bufferPool *pool) {
+    int s;
+    for (s = 0; s < pool->numShards; s++) {
+        if (__atomic_load_n(&pool->shards[s].dirtyFrames, __ATOMIC_RELAXED) >= __atomic_load_n(&pool->shards[s].writerHighWater, __ATOMIC_RELAXED)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+//writes one batch of dirty frames near the eviction end of a shard
+static int cleanNearEviction(struct backgroundWriter *writer, struct queuePool *queuePool) {
+    int lookahead = queuePool->totalNumFrames / 4; //the writer only looks at the quarter of the shard evicted next
+    int candidates, count = 0, i;
+
+    lookahead = (lookahead < writer->params.maxBatch) ? writer->params.maxBatch : lookahead;
+    lockStrategy(queuePool);
+    candidates = strategyEvictionOrder(queuePool, writer->candidates, lookahead);
+    for (i = 0; i < candidates && count < writer->params.maxBatch; i++) {
+        int frame = writer->candidates[i];
+        if (!frameIsDirty(queuePool, frame) || fixCountOf(queuePool, frame) > 0 || !pinLoadedFrame(queuePool, frame)) {
+            continue; //the pin keeps the frame from being evicted during the write
+        }
+        if (!beginWriteBack(queuePool, frame, &writer->versions[count])) {
+            unpinFrame(queuePool, frame); //cleaned, or being written, by someone else meanwhile
+            continue;
+        }
+        writer->pageNums[count] = queuePool->pageNumbers[frame];
+        writer->pages[count] = frameDataOf(queuePool, frame);
+        writer->frames[count++] = frame;
+    }
+    unlockStrategy(queuePool);
+    if (count == 0) {
+        return 0;
+    }
+
+    RC status = writeBlocks(count, queuePool->fileHandle, writer->pageNums, writer->pages);
+    for (i = 0; i < count; i++) {
+        endWriteBack(queuePool, writer->frames[i], writer->versions[i], status == RC_OK);
+        unpinFrame(queuePool, writer->frames[i]);
+    }
+    if (status != RC_OK) {
+        return 0;
+    }
+    __atomic_add_fetch(&queuePool->numWrite, count, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&queuePool->numBackgroundWrite, count, __ATOMIC_RELAXED);
+    return count;
+}
+
+static void * backgroundWriterMain(void *arg) {
+    struct bufferPool *pool = arg;
+    struct backgroundWriter *writer = pool->writer;
+    struct timespec deadline;
+    int s;
+
+    bool progress = TRUE;
+
+    pthread_mutex_lock(&pool->writerLock);
+    while (writer->running) {
+        if (!aboveHighWater(pool) || !progress) {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += writer->params.intervalMs / 1000;
+            deadline.tv_nsec += (long) (writer->params.intervalMs % 1000) * 1000000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&writer->wake, &pool->writerLock, &deadline);
+        }
+        pthread_mutex_unlock(&pool->writerLock);
+        //keep cleaning each shard while above its high-water mark and making progress
+        progress = FALSE;
+        for (s = 0; s < pool->numShards; s++) {
+            struct queuePool *queuePool = &pool->shards[s];
+            while (__atomic_load_n(&writer->running, __ATOMIC_RELAXED) && cleanNearEviction(writer, queuePool) > 0) {
+                progress = TRUE;
+                if (__atomic_load_n(&queuePool->dirtyFrames, __ATOMIC_RELAXED) < __atomic_load_n(&queuePool->writerHighWater, __ATOMIC_RELAXED)) {
+                    break;
+                }
+            }
+        }
+        pthread_mutex_lock(&pool->writerLock);
+    }
+    pthread_mutex_unlock(&pool->writerLock);
+    return NULL;
+}
+
+RC startBackgroundWriter(BM_BufferPool * const bm, BM_WriterParams *params) {
+    struct bufferPool *pool = bm->mgmtData;
+    struct backgroundWriter *writer;
+    int s;
+
+    if (pool->writer != NULL) {
+        return RC_OK;
+    }
+    writer = malloc(sizeof (struct backgroundWriter));
+    writer->params.intervalMs = (params != NULL && params->intervalMs > 0) ? params->intervalMs : WRITER_DEFAULT_INTERVAL_MS;
+    writer->params.highWaterPercent = (params != NULL && params->highWaterPercent > 0) ? params->highWaterPercent : WRITER_DEFAULT_HIGH_WATER;
+    writer->params.maxBatch = (params != NULL && params->maxBatch > 0) ? params->maxBatch : WRITER_DEFAULT_BATCH;
+    writer->running = TRUE;
+    writer->candidates = malloc(pool->totalNumFrames * sizeof (int));
+    writer->pageNums = malloc(writer->params.maxBatch * sizeof (PageNumber));
+    writer->pages = malloc(writer->params.maxBatch * sizeof (SM_PageHandle));
+    writer->frames = malloc(writer->params.maxBatch * sizeof (int));
+    writer->versions = malloc(writer->params.maxBatch * sizeof (unsigned int));
+    pthread_cond_init(&writer->wake, NULL);
+
+    for (s = 0; s < pool->numShards; s++) {
+        int highWater = (pool->shards[s].totalNumFrames * writer->params.highWaterPercent + 99) / 100;
+        __atomic_store_n(&pool->shards[s].writerHighWater, highWater, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_lock(&pool->writerLock);
+    pool->writer = writer;
+    pthread_mutex_unlock(&pool->writerLock);
+    if (pthread_create(&writer->thread, NULL, backgroundWriterMain, pool) != 0) {
+        for (s = 0; s < pool->numShards; s++) {
+            __atomic_store_n(&pool->shards[s].writerHighWater, 0, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_lock(&pool->writerLock);
+        pool->writer = NULL;
+        pthread_mutex_unlock(&pool->writerLock);
+        pthread_cond_destroy(&writer->wake);
+        free(writer->candidates);
+        free(writer->pageNums);
+        free(writer->pages);
+        free(writer->frames);
+        free(writer->versions);
+        free(writer);
+        return RC_WRITER_NOT_STARTED;
+    }
+    return RC_OK;
+}
+
+RC stopBackgroundWriter(BM_BufferPool * const bm) {
+    struct bufferPool *pool = bm->mgmtData;
+    struct backgroundWriter *writer = pool->writer;
+    int s;
+
+    if (writer == NULL) {
+        return RC_OK;
+    }
+    for (s = 0; s < pool->numShards; s++) {
+        __atomic_store_n(&pool->shards[s].writerHighWater, 0, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_lock(&pool->writerLock);
+    __atomic_store_n(&writer->running, FALSE, __ATOMIC_RELAXED);
+    pthread_cond_signal(&writer->wake);
+    pthread_mutex_unlock(&pool->writerLock);
+    pthread_join(writer->thread, NULL);
+
+    pthread_mutex_lock(&pool->writerLock);
+    pool->writer = NULL;
+    pthread_mutex_unlock(&pool->writerLock);
+    pthread_cond_destroy(&writer->wake);
+    free(writer->candidates);
+    free(writer->pageNums);
+    free(writer->pages);
+    free(writer->frames);
+    free(writer->versions);
+    free(writer);
+    return RC_OK;
+}
+
+
 RC shutdownBufferPool(BM_BufferPool * const bm) { 
+    stopBackgroundWriter(bm);
     forceFlushPool(bm);
-    struct queuePool *queuePool = bm->mgmtData;
-    struct DLnode *curr = queuePool->front;
-    while (curr != NULL) {
-        curr = curr->next;
-        free(queuePool->front->data);
-        free(queuePool->front); //freeing the node and its data from the buffer pool
-        queuePool->front = curr;
-    }
-    queuePool->front = queuePool->rear = NULL;
-    free(queuePool);
+    struct bufferPool *pool = bm->mgmtData;
+    int s;
+    if (pool->shards[0].share != NULL) {
+        leaveFrameBudget(pool);
+    }
+    closePageFile(&pool->fileHandle); //first: it waits until the completions of asynchronous reads left the frames
+    for (s = 0; s < pool->numShards; s++) {
+        freeShard(&pool->shards[s]);
+    }
+    pthread_mutex_destroy(&pool->readAhead.lock);
+    pthread_mutex_destroy(&pool->writerLock);
+    munmap(pool->frameData, pool->slabBytes); //frame data and metadata share one slab
+    free(pool->shards);
+    free(pool->readAhead.candidates);
+    free(pool->readAhead.held);
+    free(pool);
     bm->numPages = 0; //setting the no of pages of a buffer to zero
     return RC_OK;
 }
 
 
 RC forceFlushPool(BM_BufferPool * const bm) { //forcing the data to be written on the disk
-    struct queuePool * queuePool = bm->mgmtData;
-    struct DLnode *curr = queuePool->front;
-    SM_FileHandle fhandle;
-    int success = openPageFile((char *) (bm->pageFile), &fhandle);
-    if (success != RC_OK) {
-        return RC_FILE_NOT_FOUND;
+    struct bufferPool *pool = bm->mgmtData;
+    PageNumber *pageNums = malloc(pool->totalNumFrames * sizeof (PageNumber));
+    SM_PageHandle *pages = malloc(pool->totalNumFrames * sizeof (SM_PageHandle));
+    struct heldFrame *frames = malloc(pool->totalNumFrames * sizeof (struct heldFrame));
+    unsigned int *versions = malloc(pool->totalNumFrames * sizeof (unsigned int));
+    int count = 0, frame, s, i;
+
+    for (s = 0; s < pool->numShards; s++) { //every dirty page of every shard goes into one batch
+        struct queuePool *queuePool = &pool->shards[s];
+        for (frame = 0; frame < queuePool->totalNumFrames; frame++) {
+            if (!frameIsDirty(queuePool, frame) || !pinLoadedFrame(queuePool, frame)) { //pinned until written
+                continue;
+            }
+            if (!beginWriteBack(queuePool, frame, &versions[count])) { //cleaned, or being written, by someone else meanwhile
+                unpinFrame(queuePool, frame);
+                continue;
+            }
+            pageNums[count] = queuePool->pageNumbers[frame];
+            pages[count] = frameDataOf(queuePool, frame);
+            frames[count].shard = queuePool;
+            frames[count++].frame = frame;
+        }
+    }
+
+    if (count == 0) { //nothing dirty
+        free(pageNums);
+        free(pages);
+        free(frames);
+        free(versions);
+        return RC_OK;
     }
-    while (curr != NULL) {
-        if (curr->dirty == 1) {
-            writeBlock(curr->pageNumber, &fhandle, curr->data); //if page is dirty its writing to the disk
-            curr->dirty = 0;
-            queuePool->numWrite++;
+    RC status = writeBlocks(count, &pool->fileHandle, pageNums, pages); //returns once every write has completed
+    for (i = 0; i < count; i++) { //the flags are cleared once the pages are on disk
+        endWriteBack(frames[i].shard, frames[i].frame, versions[i], status == RC_OK);
+        unpinFrame(frames[i].shard, frames[i].frame);
+        if (status == RC_OK) {
+            __atomic_add_fetch(&frames[i].shard->numWrite, 1, __ATOMIC_RELAXED);
         }
-        curr = curr->next; //does the forceflushpool for all the data in the buffer
     }
-    closePageFile(&fhandle);
-    return RC_OK;
+
+    free(pageNums);
+    free(pages);
+    free(frames);
+    free(versions);
+    return status;
 }
 
 
-PageNumber *getFrameContents(BM_BufferPool * const bm) {
-    return 0;
+//passes an access pattern hint for the pool's page file on to the kernel, see adviseFile
+RC adviseBufferPool(BM_BufferPool * const bm, SM_AccessAdvice advice, const PageNumber firstPage, int numPages) {
+    struct bufferPool *pool = bm->mgmtData;
+    return adviseFile(&pool->fileHandle, advice, firstPage, numPages);
+}
+
+
+PageNumber *getFrameContents(BM_BufferPool * const bm) { //will return an array which will give the page number held by each frame
+    struct bufferPool *pool = bm->mgmtData;
+    return pool->pageNumbers; //the frames of every shard, shard by shard
 }
 
 
 bool *getDirtyFlags(BM_BufferPool *const bm) { //will return an array which will give the dirty bit value of each page
-    struct queuePool *queue = bm->mgmtData;
-    struct DLnode *curr = queue->front;
-    while (curr != NULL) {
-        queue->dirtyBitArray[curr->frameNum] = curr->dirty;
-        curr = curr->next;
-    }
-    return queue->dirtyBitArray;
+    struct bufferPool *pool = bm->mgmtData;
+    return pool->dirtyFlags;
 }
 
 
 int *getFixCounts(BM_BufferPool * const bm) { //will return an array which will give the fix count of each page
-    struct queuePool *queue = bm->mgmtData;
-    struct DLnode *temp = queue->front;
-    while (temp != NULL) {
-        queue->fixCountArray[temp->frameNum] = temp->fixcount;
-        temp = temp->next;
+    struct bufferPool *pool = bm->mgmtData;
+    return pool->fixCounts;
+}
+
+
+//adds up one of the int counters of struct queuePool over the shards of a pool
+static int sumOverShards(BM_BufferPool * const bm, size_t counter) {
+    struct bufferPool *pool = bm->mgmtData;
+    int sum = 0, s;
+    for (s = 0; s < pool->numShards; s++) {
+        sum += __atomic_load_n((int *) ((char *) &pool->shards[s] + counter), __ATOMIC_RELAXED);
     }
-    return queue->fixCountArray;
+    return sum;
 }
 
 
 int getNumReadIO(BM_BufferPool * const bm) { //will return the number of reads done
-    struct queuePool *queue = bm->mgmtData;
-    return queue->numRead;
+    return sumOverShards(bm, offsetof(struct queuePool, numRead));
 }
 
 
 int getNumWriteIO(BM_BufferPool * const bm) { //will return the number of writes done
-    struct queuePool *queue = bm->mgmtData;
-    return queue->numWrite;
+    return sumOverShards(bm, offsetof(struct queuePool, numWrite));
 }
 
 
+int getPageSize(BM_BufferPool * const bm) { //will return the size of the pages, and frames, of the pool
+    struct bufferPool *pool = bm->mgmtData;
+    return pool->fileHandle.pageSize;
+}
 
 
+int getNumReadAheadIO(BM_BufferPool * const bm) { //will return the number of pages loaded by read-ahead
+    return sumOverShards(bm, offsetof(struct queuePool, numReadAhead));
+}
+
 
+int getNumBackgroundWriteIO(BM_BufferPool * const bm) { //will return the number of pages written by the background writer
+    return sumOverShards(bm, offsetof(struct queuePool, numBackgroundWrite));
+}
 
 
+int getNumMergedReadIO(BM_BufferPool * const bm) { //will return the number of pages of numRead read along with a neighbouring page
+    return sumOverShards(bm, offsetof(struct queuePool, reads.numMerged));
+}
 
 
+int getNumFramesInUse(BM_BufferPool * const bm) { //will return the number of frames holding memory, parked frames of a budgeted pool left out
+    struct bufferPool *pool = bm->mgmtData;
+    int sum = 0, s;
+    for (s = 0; s < pool->numShards; s++) {
+        struct queuePool *shard = &pool->shards[s];
+        sum += (shard->share != NULL) ? __atomic_load_n(&shard->share->charged, __ATOMIC_RELAXED)
+                : __atomic_load_n(&shard->occupiedFrames, __ATOMIC_RELAXED);
+    }
+    return sum;
+}
@@ -7,6 +7,9 @@
 // Include bool DT
 #include "dt.h"
 
+// Include SM_IOMode
+#include "storage_mgr.h"
+
 // Replacement Strategies
 
 typedef enum ReplacementStrategy {
@@ -14,7 +17,10 @@ typedef enum ReplacementStrategy {
     RS_LRU = 1,
     RS_CLOCK = 2,
     RS_LFU = 3,
-    RS_LRU_K = 4
+    RS_LRU_K = 4,
+    RS_ARC = 5,
+    RS_2Q = 6,
+    RS_CLOCK_LOCKFREE = 7 // CLOCK without the pool lock, for pools pinned from many threads
 } ReplacementStrategy;
 
 // Data Types and Structures
@@ -30,6 +36,38 @@ typedef struct BM_BufferPool {
     struct hash *pageTable;
 } BM_BufferPool;
 
+// optional stratData of RS_LFU
+typedef struct BM_LFUParams {
+    bool aging; // let pages that were hot long ago decay out (LFU with dynamic aging)
+} BM_LFUParams;
+
+// stratData of RS_LRU_K is an optional int * holding K, K defaults to 2
+
+// options of the background writer, fields <= 0 take the defaults
+typedef struct BM_WriterParams {
+    int intervalMs;       // wake up at least this often, 100 ms
+    int highWaterPercent; // wake up at once when this share of frames is dirty, 10%
+    int maxBatch;         // pages written per batch, 64
+} BM_WriterParams;
+
+// modes of a page latch
+typedef enum BM_LatchMode {
+    BM_LATCH_SHARED = 0,   // many readers at once
+    BM_LATCH_EXCLUSIVE = 1 // one writer, no readers
+} BM_LatchMode;
+
+// access strategies of pinPageWithStrategy, after PostgreSQL's BufferAccessStrategy
+typedef enum BM_AccessType {
+    BM_ACCESS_NORMAL = 0,     // like pinPage
+    BM_ACCESS_BULK_READ = 1,  // scans: pages recycle a small ring of frames, dirty ones are left to the pool
+    BM_ACCESS_BULK_WRITE = 2  // bulk loads: a larger ring whose dirty frames are written back and reused
+} BM_AccessType;
+
+typedef struct BM_AccessStrategy BM_AccessStrategy;
+
+// completion token of pinPageAsync
+typedef struct BM_PinRequest BM_PinRequest;
+
 typedef struct BM_PageHandle {
     PageNumber pageNum;
     char *data;
@@ -48,15 +86,58 @@ typedef struct BM_PageHandle {
 RC initBufferPool(BM_BufferPool * const bm, const char *const pageFileName,
         const int numPages, ReplacementStrategy strategy,
         void *stratData);
+// like initBufferPool, ioMode SM_IO_DIRECT keeps pages out of the kernel page cache,
+// SM_IO_MMAP serves misses by a copy from a mapping of the file
+RC initBufferPoolWithMode(BM_BufferPool * const bm, const char *const pageFileName,
+        const int numPages, ReplacementStrategy strategy,
+        void *stratData, SM_IOMode ioMode);
+// like initBufferPoolWithMode, splits the frames into numShards shards with a replacement
+// strategy, page table and lock each. A page always goes to the same shard.
+RC initBufferPoolSharded(BM_BufferPool * const bm, const char *const pageFileName,
+        const int numPages, ReplacementStrategy strategy,
+        void *stratData, SM_IOMode ioMode, int numShards);
 RC shutdownBufferPool(BM_BufferPool * const bm);
 RC forceFlushPool(BM_BufferPool * const bm);
+RC adviseBufferPool(BM_BufferPool * const bm, SM_AccessAdvice advice, const PageNumber firstPage, int numPages);
+RC startBackgroundWriter(BM_BufferPool * const bm, BM_WriterParams *params);
+RC stopBackgroundWriter(BM_BufferPool * const bm);
+// detects sequential pins and reads up to maxPages pages ahead, 0 turns it off (the default)
+RC setReadAhead(BM_BufferPool * const bm, int maxPages);
+// pools opened from now on share maxFrames frames, their numPages only caps them. Frames move
+// to the pools that would hit more with them. 0 turns it off once no budgeted pool is open
+RC setFrameBudget(int maxFrames);
 
-// Buffer Manager Interface Access Pages
+// Buffer Manager Interface Access Pages, safe to call from several threads at once
 RC markDirty(BM_BufferPool * const bm, BM_PageHandle * const page);
 RC unpinPage(BM_BufferPool * const bm, BM_PageHandle * const page);
 RC forcePage(BM_BufferPool * const bm, BM_PageHandle * const page);
 RC pinPage(BM_BufferPool * const bm, BM_PageHandle * const page,
         const PageNumber pageNum);
+// pin handles[i] to pageNums[i] for n pages at once, runs of missing pages are read with
+// one vectored read. Either every page is pinned or none is
+RC pinPages(BM_BufferPool * const bm, BM_PageHandle * const handles,
+        const PageNumber * const pageNums, int n);
+RC unpinPages(BM_BufferPool * const bm, BM_PageHandle * const handles, int n);
+// pages pinned under a bulk access strategy don't displace the pages in use. A strategy belongs
+// to one thread, free it before shutting the pool down. BM_ACCESS_NORMAL gives NULL, which pins as pinPage
+BM_AccessStrategy *getAccessStrategy(BM_BufferPool * const bm, BM_AccessType type);
+void freeAccessStrategy(BM_AccessStrategy *strategy);
+RC pinPageWithStrategy(BM_BufferPool * const bm, BM_PageHandle * const page,
+        const PageNumber pageNum, BM_AccessStrategy *strategy);
+// start a pin and return before the page is read, waitPin finishes it and fills the handle.
+// Every request has to be waited for, before the pool is shut down
+RC pinPageAsync(BM_BufferPool * const bm, const PageNumber pageNum, BM_PinRequest **request);
+bool pinReady(BM_PinRequest *request);
+RC waitPin(BM_PinRequest *request, BM_PageHandle * const page);
+// latch the content of a pinned page, release it before unpinning. markDirty fails with
+// RC_PAGE_LATCHED_SHARED while readers hold the latch, writers latch the page exclusively
+RC latchPage(BM_BufferPool * const bm, BM_PageHandle * const page, BM_LatchMode mode);
+RC unlatchPage(BM_BufferPool * const bm, BM_PageHandle * const page);
+// optimistic reads without pin or latch: read page->data after beginOptimisticRead and trust
+// what was read only when validateOptimisticRead returns TRUE, pin the page when either fails
+RC beginOptimisticRead(BM_BufferPool * const bm, BM_PageHandle * const page,
+        const PageNumber pageNum, unsigned int *version);
+bool validateOptimisticRead(BM_BufferPool * const bm, BM_PageHandle * const page, unsigned int version);
 
 // Statistics Interface
 PageNumber *getFrameContents(BM_BufferPool * const bm);
@@ -64,5 +145,10 @@ bool *getDirtyFlags(BM_BufferPool * const bm);
 int *getFixCounts(BM_BufferPool * const bm);
 int getNumReadIO(BM_BufferPool * const bm);
 int getNumWriteIO(BM_BufferPool * const bm);
+int getPageSize(BM_BufferPool * const bm);
+int getNumBackgroundWriteIO(BM_BufferPool * const bm);
+int getNumReadAheadIO(BM_BufferPool * const bm);
+int getNumFramesInUse(BM_BufferPool * const bm);
+int getNumMergedReadIO(BM_BufferPool * const bm);
 
 #endif
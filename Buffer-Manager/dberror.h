@@ -4,7 +4,9 @@
 #include "stdio.h"
 
 /* module wide constants */
-#define PAGE_SIZE 5
+#define PAGE_SIZE 4096 // default page size of new page files
+#define MIN_PAGE_SIZE 4096
+#define MAX_PAGE_SIZE 65536
 
 /* return code definitions */
 typedef int RC;
@@ -30,6 +32,8 @@ typedef int RC;
 #define RC_PAGE_NUMBER_NOT_FOUND 401
 #define RC_PREVIOUS_BLOCK_DOES_NOT_EXIST 402
 #define RC_APPEND_ERROR 403
+#define RC_INVALID_PAGE_SIZE 404
+#define RC_INVALID_FILE_HEADER 405
 
 
 
@@ -39,6 +43,12 @@ typedef int RC;
 #define RC_NON_EXISTING_PAGE_IN_FRAME 506
 #define NO_SUCH_METHOD 507
 #define UPIN_ERROR 508
+#define RC_MEMORY_ALLOCATION_ERROR 509
+#define RC_WRITER_NOT_STARTED 510
+#define RC_PAGE_LATCHED_SHARED 511
+#define RC_FRAME_BUDGET_EXCEEDED 512
+#define RC_FRAME_BUDGET_IN_USE 513
+#define RC_INVALID_PAGE_COUNT 514
 
 
 /* holder for error messages */
@@ -0,0 +1,470 @@
+#include <linux/io_uring.h>
+#include <limits.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+/**********************************************************************************
+ * Batched page writes and asynchronous page reads for the storage manager
+ * (included by storage_mgr.c).
+ *
+ * The pages of a batch are sorted by page number and runs of consecutive pages
+ * become one vectored write of at most maxWriteSize bytes. The writes are
+ * handed to io_uring in one go, as many in flight as the ring holds, and the
+ * batch returns once every write has completed. Where io_uring is unavailable
+ * (old kernels, seccomp filters) a group of worker threads issues the writes
+ * with pwritev instead.
+ *
+ * Asynchronous reads (readBlockAsync) go to a ring of their own per file,
+ * whose completions a thread of the file reaps, see asyncReaderMain.
+ ***********************************************************************************/
+
+#define IO_RING_ENTRIES 128 //writes in flight per batch
+#define IO_WORKER_THREADS 8 //pwrite workers of the fallback
+#define IO_ENGINE_UNAVAILABLE -1 //io_uring can't be used, the batch has to go to the workers
+#define IO_DEFAULT_MAX_WRITE_SIZE (256 * 1024)
+
+struct ioRequest { //one run of consecutive pages
+    off_t offset;
+    struct iovec *iov; //one entry per page
+    int iovcnt;
+    size_t size;
+};
+
+struct uringRing {
+    int fd;
+    unsigned entries;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize;
+};
+
+static SM_BatchEngine batchEngine = SM_BATCH_AUTO;
+static int maxWriteSize = IO_DEFAULT_MAX_WRITE_SIZE;
+
+//skips the first done bytes of an iovec array, the array is changed in place
+static struct iovec * ioAdvance(struct iovec *iov, int *iovcnt, size_t done) {
+    while (*iovcnt > 0 && done >= iov->iov_len) {
+        done -= iov->iov_len;
+        iov++;
+        (*iovcnt)--;
+    }
+    if (*iovcnt > 0) {
+        iov->iov_base = (char *) iov->iov_base + done;
+        iov->iov_len -= done;
+    }
+    return iov;
+}
+
+//writes all buffers of iov from offset on, retrying short and interrupted writes
+//and, like pwriteFully, writes the O_DIRECT refused on the page cache
+static RC ioWritevFully(struct storageFile *file, struct iovec *iov, int iovcnt, off_t offset) {
+    while (iovcnt > 0) {
+        int direct = isDirect(file);
+        ssize_t put = pwritev(file->fd, iov, iovcnt, offset);
+        if (put < 0) {
+            if (errno == EINTR || (errno == EINVAL && dropDirect(file, direct))) {
+                continue;
+            }
+            return RC_WRITE_FAILED;
+        }
+        offset += put;
+        iov = ioAdvance(iov, &iovcnt, put);
+    }
+    return RC_OK;
+}
+
+/**********************************************************************************
+ * io_uring engine, talking to the kernel through the raw system calls
+ ***********************************************************************************/
+
+static void uringDestroy(struct uringRing *ring) {
+    if (ring == NULL) {
+        return;
+    }
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->entries * sizeof (struct io_uring_sqe));
+    }
+    if (ring->cqRing != NULL && ring->cqRing != MAP_FAILED && ring->cqRing != ring->sqRing) {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    if (ring->sqRing != NULL && ring->sqRing != MAP_FAILED) {
+        munmap(ring->sqRing, ring->sqRingSize);
+    }
+    close(ring->fd);
+    free(ring);
+}
+
+//sets up a ring with IO_RING_ENTRIES submission slots, NULL when io_uring is unavailable
+static struct uringRing * uringCreate(void) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof (params));
+    int fd = syscall(__NR_io_uring_setup, IO_RING_ENTRIES, &params);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct uringRing *ring = calloc(1, sizeof (struct uringRing));
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof (unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) { //both rings share one mapping
+        if (ring->cqRingSize > ring->sqRingSize) {
+            ring->sqRingSize = ring->cqRingSize;
+        }
+        ring->cqRingSize = ring->sqRingSize;
+    }
+
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED) {
+        uringDestroy(ring);
+        return NULL;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cqRing = ring->sqRing;
+    } else {
+        ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    }
+    ring->sqes = mmap(NULL, params.sq_entries * sizeof (struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        uringDestroy(ring);
+        return NULL;
+    }
+
+    ring->sqHead = (unsigned *) ((char *) ring->sqRing + params.sq_off.head);
+    ring->sqTail = (unsigned *) ((char *) ring->sqRing + params.sq_off.tail);
+    ring->sqMask = (unsigned *) ((char *) ring->sqRing + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *) ((char *) ring->sqRing + params.sq_off.array);
+    ring->cqHead = (unsigned *) ((char *) ring->cqRing + params.cq_off.head);
+    ring->cqTail = (unsigned *) ((char *) ring->cqRing + params.cq_off.tail);
+    ring->cqMask = (unsigned *) ((char *) ring->cqRing + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) ((char *) ring->cqRing + params.cq_off.cqes);
+    return ring;
+}
+
+/**********************************************************************************
+ * Function Name: uringWriteBatch
+ *
+ * Description:
+ *      submits the writes of a batch to the ring, up to ring size at a time, and
+ *      reaps their completions until every write is done. A short write is
+ *      finished with pwritev, as is a write failing with EINVAL, which drops
+ *      O_DIRECT when the filesystem refused it. When the ring stops taking
+ *      writes the ones the kernel took are still reaped, their buffers belong
+ *      to the caller, and the rest of the batch is written with pwritev.
+ *
+ * Return:
+ *      RC_OK when every write completed, RC_WRITE_FAILED when one failed,
+ *      IO_ENGINE_UNAVAILABLE when the kernel refused the ring before any write
+ *      completed
+ *
+ ***********************************************************************************/
+
+static RC uringWriteBatch(struct uringRing *ring, struct storageFile *file, struct ioRequest *requests, int count) {
+    int submitted = 0, completed = 0, inFlight = 0, pending = 0, aborted = 0;
+    RC rc = RC_OK;
+    int i;
+
+    while (inFlight > 0 || (!aborted && submitted < count)) {
+        unsigned tail = *ring->sqTail;
+        unsigned head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+        while (!aborted && submitted < count && inFlight < (int) ring->entries && tail - head < ring->entries) {
+            unsigned slot = tail & *ring->sqMask;
+            struct io_uring_sqe *sqe = &ring->sqes[slot];
+            memset(sqe, 0, sizeof (*sqe));
+            sqe->opcode = IORING_OP_WRITEV;
+            sqe->fd = file->fd;
+            sqe->addr = (unsigned long) requests[submitted].iov;
+            sqe->len = requests[submitted].iovcnt;
+            sqe->off = requests[submitted].offset;
+            sqe->user_data = submitted;
+            ring->sqArray[slot] = slot;
+            tail++;
+            submitted++;
+            inFlight++;
+            pending++;
+        }
+        __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+
+        int entered = syscall(__NR_io_uring_enter, ring->fd, pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (entered < 0 && errno == EINTR) {
+            continue;
+        }
+        if (entered < 0 && !aborted) {
+            //take back the writes the kernel didn't consume, the last ones queued
+            unsigned consumed = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+            unsigned untaken = tail - consumed;
+            __atomic_store_n(ring->sqTail, consumed, __ATOMIC_RELEASE);
+            submitted -= untaken;
+            inFlight -= untaken;
+            pending = 0;
+            aborted = 1;
+            continue;
+        }
+        if (entered < 0) {
+            sched_yield(); //waiting failed as well, poll the completion ring
+        } else {
+            pending -= entered;
+        }
+
+        unsigned cqHead = *ring->cqHead;
+        unsigned cqTail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        while (cqHead != cqTail) {
+            struct io_uring_cqe *cqe = &ring->cqes[cqHead & *ring->cqMask];
+            struct ioRequest *request = &requests[cqe->user_data];
+            if (cqe->res == -EINVAL) {
+                if (ioWritevFully(file, request->iov, request->iovcnt, request->offset) != RC_OK) {
+                    rc = RC_WRITE_FAILED;
+                }
+            } else if (cqe->res < 0) {
+                rc = RC_WRITE_FAILED;
+            } else if ((size_t) cqe->res < request->size
+                    && ioWritevFully(file, ioAdvance(request->iov, &request->iovcnt, cqe->res), request->iovcnt, request->offset + cqe->res) != RC_OK) {
+                rc = RC_WRITE_FAILED;
+            }
+            cqHead++;
+            completed++;
+            inFlight--;
+        }
+        __atomic_store_n(ring->cqHead, cqHead, __ATOMIC_RELEASE);
+    }
+
+    if (aborted && completed == 0) {
+        return IO_ENGINE_UNAVAILABLE; //nothing was written, the workers take the whole batch
+    }
+    for (i = submitted; i < count; i++) {
+        if (ioWritevFully(file, requests[i].iov, requests[i].iovcnt, requests[i].offset) != RC_OK) {
+            rc = RC_WRITE_FAILED;
+        }
+    }
+    return rc;
+}
+
+/**********************************************************************************
+ * pwritev worker fallback
+ ***********************************************************************************/
+
+struct ioWorkerBatch {
+    struct storageFile *file;
+    struct ioRequest *requests;
+    int count;
+    int next; //next request to claim
+    RC rc;
+};
+
+static void * ioWorker(void *arg) {
+    struct ioWorkerBatch *batch = arg;
+    int i;
+    while ((i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED)) < batch->count) {
+        struct ioRequest *request = &batch->requests[i];
+        if (ioWritevFully(batch->file, request->iov, request->iovcnt, request->offset) != RC_OK) {
+            __atomic_store_n(&batch->rc, RC_WRITE_FAILED, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+//spreads the writes of a batch over up to IO_WORKER_THREADS threads and waits for all of them
+static RC threadWriteBatch(struct storageFile *file, struct ioRequest *requests, int count) {
+    struct ioWorkerBatch batch = {file, requests, count, 0, RC_OK};
+    pthread_t workers[IO_WORKER_THREADS];
+    int started = 0, i;
+
+    while (started < IO_WORKER_THREADS && started < count - 1
+            && pthread_create(&workers[started], NULL, ioWorker, &batch) == 0) {
+        started++;
+    }
+    ioWorker(&batch); //the caller takes part as well
+    for (i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    return batch.rc;
+}
+
+extern void setBatchWriteEngine(SM_BatchEngine engine) {
+    batchEngine = engine;
+}
+
+//caps the size of one coalesced write, a run holds at least one page
+extern void setMaxWriteSize(int bytes) {
+    maxWriteSize = (bytes > 0) ? bytes : IO_DEFAULT_MAX_WRITE_SIZE;
+}
+
+/**********************************************************************************
+ * Asynchronous reads
+ *
+ * Every read is one IORING_OP_READV submitted as soon as it is asked for, up
+ * to ring size in flight; a reader asking for more waits for a completion.
+ * One completion thread per file waits on the ring, finishes short reads with
+ * preadv and calls the read's callback. It stops at a NOP submitted by
+ * asyncReaderDestroy once the reads in flight are done.
+ ***********************************************************************************/
+
+struct asyncRead { //one page read in flight
+    struct iovec iov;
+    off_t offset;
+    SM_ReadCallback done;
+    void *context;
+};
+
+struct asyncReader {
+    struct uringRing *ring;
+    struct storageFile *file;
+    pthread_mutex_t lock; //guards the submission queue and inFlight
+    pthread_cond_t room; //a read completed
+    int inFlight;
+    pthread_t completer;
+};
+
+static RC preadvFully(struct storageFile *file, struct iovec *iov, int iovcnt, off_t offset);
+
+//hands one request to the ring and submits it, called with the reader's lock held. FALSE when the kernel refused it.
+static int asyncSubmit(struct asyncReader *reader, int opcode, struct asyncRead *read, int fd) {
+    struct uringRing *ring = reader->ring;
+    unsigned tail = *ring->sqTail;
+    unsigned slot = tail & *ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[slot];
+
+    memset(sqe, 0, sizeof (*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    if (read != NULL) {
+        sqe->addr = (unsigned long) &read->iov;
+        sqe->len = 1;
+        sqe->off = read->offset;
+    }
+    sqe->user_data = (unsigned long) read; //NULL for the NOP that stops the completion thread
+    ring->sqArray[slot] = slot;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    while (1) {
+        int entered = syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0);
+        if (entered == 1) {
+            return 1;
+        }
+        if (entered < 0 && errno == EINTR) {
+            continue;
+        }
+        __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE); //not consumed, the entry is taken back
+        return 0;
+    }
+}
+
+//the completion thread of a file
+static void * asyncReaderMain(void *arg) {
+    struct asyncReader *reader = arg;
+    struct uringRing *ring = reader->ring;
+    int stopping = 0;
+
+    while (1) {
+        unsigned cqHead = *ring->cqHead;
+        unsigned cqTail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        int completed = 0;
+        if (cqHead != cqTail) { //the reads were filled in before their submission under the lock, taking it orders them for tools that can't see the ring
+            pthread_mutex_lock(&reader->lock);
+            pthread_mutex_unlock(&reader->lock);
+        }
+        while (cqHead != cqTail) {
+            struct io_uring_cqe *cqe = &ring->cqes[cqHead & *ring->cqMask];
+            struct asyncRead *read = (struct asyncRead *) (unsigned long) cqe->user_data;
+            int res = cqe->res;
+            cqHead++;
+            __atomic_store_n(ring->cqHead, cqHead, __ATOMIC_RELEASE);
+            if (read == NULL) {
+                stopping = 1;
+                continue;
+            }
+            RC rc = RC_OK;
+            if (res < 0 || (size_t) res < read->iov.iov_len) { //failed or short: the rest, or all of it, the slow way
+                size_t done = (res > 0) ? (size_t) res : 0;
+                struct iovec rest = {(char *) read->iov.iov_base + done, read->iov.iov_len - done};
+                rc = (res < 0 && res != -EINVAL && res != -EAGAIN) ? RC_READ_NON_EXISTING_PAGE
+                        : preadvFully(reader->file, &rest, 1, read->offset + done);
+            }
+            read->done(read->context, rc);
+            free(read);
+            completed++;
+        }
+        if (completed > 0) {
+            pthread_mutex_lock(&reader->lock);
+            reader->inFlight -= completed;
+            pthread_cond_broadcast(&reader->room);
+            pthread_mutex_unlock(&reader->lock);
+        }
+        if (stopping) { //nothing is in flight any more
+            return NULL;
+        }
+        syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0); //EINTR just goes round again
+    }
+}
+
+//sets up the reads of a file, NULL when io_uring is unavailable
+static struct asyncReader * asyncReaderCreate(struct storageFile *file) {
+    struct asyncReader *reader = malloc(sizeof (struct asyncReader));
+    reader->ring = uringCreate();
+    if (reader->ring == NULL) {
+        free(reader);
+        return NULL;
+    }
+    reader->file = file;
+    reader->inFlight = 0;
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->room, NULL);
+    if (pthread_create(&reader->completer, NULL, asyncReaderMain, reader) != 0) {
+        pthread_mutex_destroy(&reader->lock);
+        pthread_cond_destroy(&reader->room);
+        uringDestroy(reader->ring);
+        free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+//waits for the reads in flight and stops the completion thread
+static void asyncReaderDestroy(struct asyncReader *reader, int fd) {
+    if (reader == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&reader->lock);
+    while (reader->inFlight > 0) {
+        pthread_cond_wait(&reader->room, &reader->lock);
+    }
+    int stopped = asyncSubmit(reader, IORING_OP_NOP, NULL, fd);
+    pthread_mutex_unlock(&reader->lock);
+    if (!stopped) { //the thread can't be woken, it is left waiting on its ring
+        pthread_detach(reader->completer);
+        return;
+    }
+    pthread_join(reader->completer, NULL);
+    pthread_mutex_destroy(&reader->lock);
+    pthread_cond_destroy(&reader->room);
+    uringDestroy(reader->ring);
+    free(reader);
+}
+
+//starts reading size bytes at offset into buffer. FALSE when the kernel refused, the read is then not started.
+static int asyncRead(struct asyncReader *reader, int fd, char *buffer, size_t size, off_t offset, SM_ReadCallback done, void *context) {
+    struct asyncRead *read = malloc(sizeof (struct asyncRead));
+    read->iov.iov_base = buffer;
+    read->iov.iov_len = size;
+    read->offset = offset;
+    read->done = done;
+    read->context = context;
+
+    pthread_mutex_lock(&reader->lock);
+    while (reader->inFlight >= (int) reader->ring->entries) {
+        pthread_cond_wait(&reader->room, &reader->lock);
+    }
+    int submitted = asyncSubmit(reader, IORING_OP_READV, read, fd);
+    if (submitted) {
+        reader->inFlight++;
+    }
+    pthread_mutex_unlock(&reader->lock);
+    if (!submitted) {
+        free(read);
+    }
+    return submitted;
+}
@@ -5,120 +5,396 @@
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
-#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
 #include "storage_mgr.h"
 #include "buffer_mgr.h"
 
-#define MAX_CAPACITY 200;
+#define HASH_EMPTY_SLOT -1
 
-struct DLnode {
-    int pageNumber;
-    int frameNum;
-    int fixcount;
-    int dirty;
+#define FRAME_ALIGNMENT 4096 //frames start on memory page boundaries
+#define LIST_NONE -1 //no frame, bucket or slot
+#define CACHE_LINE_SIZE 64
+
+struct heldFrame { //a frame pinned by read-ahead
+    struct queuePool *shard;
+    int frame;
+};
+
+struct readAhead { //sequential access detection of a pool, driven by pinPage
+    int maxPages; //largest window, 0 while read-ahead is off
+    PageNumber lastPage; //page of the previous pin
+    int run; //pins in a row that asked for the page after the previous one
+    int window; //pages of the last window, 0 until a run was detected
+    PageNumber windowStart, windowEnd; //pages of the last window, reaching windowStart reads the next one
+    int *candidates; //eviction order scratch
+    struct heldFrame *held; //pages read ahead earlier, pinned while a window is placed
+    pthread_mutex_t lock; //one thread runs read-ahead at a time, the others skip it
+};
+
+struct queuedRead { //a miss waiting for its page, on the stack of the pinning thread
+    PageNumber pageNum;
     char *data;
-    struct DLnode *next, *prev;
+    RC rc;
+    bool finished;
+    struct queuedRead *next;
+};
+
+struct readRun { //consecutive pages of a stream read with one readBlocks, on the stack of the miss that started it
+    PageNumber first;
+    int count;
+    bool issued; //being read, no more misses join
+    struct queuedRead *misses; //one per page of the run
+    struct readRun *next;
+};
+
+#define READ_RECENT_PAGES 64 //slots of pages read alone a stream may start from, a power of two
+
+struct readQueue { //the reads of a shard's misses, see queueRead
+    pthread_mutex_t lock; //guards the queue, held for no other lock and during no read
+    pthread_cond_t finished; //a run was read
+    struct readRun *runs; //runs waiting to be read and being read
+    PageNumber recent[READ_RECENT_PAGES]; //pages read alone lately, page p in slot p % READ_RECENT_PAGES
+    int waiting; //misses waiting for a run to be read, only they need waking
+    int numMerged; //pages read along with a neighbouring page
+};
+
+/**********************************************************************************
+ * Concurrency
+ *
+ * pinPage, unpinPage, markDirty and forcePage may be called from any number
+ * of threads at once.
+ *  - fix counts, dirty flags and the statistics counters are atomic
+ *  - a dirty flag is cleared once the page is on disk, not before its write.
+ *    One thread at a time writes a frame back, and a markDirty during the
+ *    write leaves the flag set (beginWriteBack, endWriteBack).
+ *  - the page table is split into stripes with a lock each (struct pageTable)
+ *  - a frame whose page is being read in or evicted has ioInProgress set.
+ *    Threads pinning the page meanwhile wait on the frame's latch and
+ *    condition until the I/O is done. A latch is only held for the flag.
+ *  - poolLock guards the strategy state. It is only held for the
+ *    bookkeeping of a pin, never during disk I/O: a dirty victim is written
+ *    back with the lock released. RS_CLOCK_LOCKFREE keeps its state in
+ *    atomics and takes no poolLock at all (lockStrategy), unless the pool
+ *    draws from the frame budget, whose share of a shard it guards as well.
+ *  - free frames are claimed by a compare-and-swap on occupiedFrames, used
+ *    frames by one on their fix count, so two threads never take one frame
+ *  - the content of a pinned page is guarded by its page latch (latchPage),
+ *    held shared by any number of readers or exclusive by one writer. It is
+ *    up to the callers: the pool itself never takes it.
+ *  - the version next to the latch changes with every exclusive latch and
+ *    every new page in the frame, for optimistic readers that take no lock.
+ *  - a page is read once however many threads miss it: the first files it
+ *    in the page table with ioInProgress set, the others find it there and
+ *    wait. The reads of misses go through the shard's read queue, which merges
+ *    adjacent pages missed at the same time (queueRead).
+ * Locks are taken in the order frame budget lock, poolLock, page table
+ * stripe, frame latch.
+ * A page latch is taken with no pool lock held.
+ *
+ * A pool may be split into shards (initBufferPoolSharded). Every shard is a
+ * struct queuePool of its own, with its frames, page table, strategy,
+ * counters and poolLock, and a page always lives in the same shard. A thread
+ * holds the locks of one shard at a time.
+ ***********************************************************************************/
+
+struct pageLatch { //reader-writer latch of a frame's content, alone on its cache line
+    int state; //LATCH_EXCLUSIVE, LATCH_WRITER_WAITING and the number of readers
+    unsigned int version; //odd while a writer holds the latch, see beginOptimisticRead
+    char padding[CACHE_LINE_SIZE - sizeof (int) - sizeof (unsigned int)];
 };
 
-struct queuePool {
+struct queuePool { //one shard of a pool, the whole pool unless it is sharded
     int occupiedFrames;
     int totalNumFrames;
-    struct DLnode *front, *rear;
-    char *data;
     int numRead;
     int numWrite;
-    bool *dirtyBitArray;
-    int *fixCountArray;
+    int numBackgroundWrite; //pages of numWrite written by the background writer
+    int numReadAhead; //pages of numRead loaded by read-ahead
+    ReplacementStrategy strategy;
+    SM_FileHandle *fileHandle; //page file of the pool, shared by its shards
+    int pageSize; //taken from the page file header
+    char *frameData; //the shard's part of the pool's slab, frame i starts at frameData + i * pageSize
+    PageNumber *pageNumbers; //per frame metadata, the shard's slices of the pool's arrays indexed by frame number
+    int *fixCounts;
+    bool *dirtyFlags;
+    unsigned int *dirtyVersions; //moved on by every markDirty, odd while the frame is written back, see beginWriteBack
+    bool *prefetched; //loaded by read-ahead and not pinned since
+    bool *ioInProgress; //the page is being read into the frame or written back to be evicted
+    bool *ringFrames; //held by the ring of a bulk access strategy and out of the strategy, see getAccessStrategy
+    pthread_mutex_t *frameLatches; //guard ioInProgress for the waiters
+    pthread_cond_t *ioDone;
+    struct pageLatch *pageLatches; //content latch of every frame
+    int dirtyFrames; //frames with their dirty flag set
+    void *strategyData; //replacement state of the pool's strategy
+    struct pageTable *pageTable; //page number to frame
+    pthread_mutex_t poolLock; //guards the strategy, see above
+    struct budgetShare *share; //NULL unless the pool draws its frames from the frame budget
+    struct readQueue reads; //misses of the shard being read
+    int writerHighWater; //dirty frames that wake the writer, 0 without a writer
+
+};
+
+struct bufferPool { //mgmtData of a BM_BufferPool
+    int numShards;
+    struct queuePool *shards;
+    int totalNumFrames;
+    SM_FileHandle fileHandle; //page file, open from initBufferPool until shutdownBufferPool
+    char *frameData; //one page aligned slab for the frames of every shard
+    size_t slabBytes; //for munmap
+    PageNumber *pageNumbers; //per frame metadata of the whole pool, every shard owns a consecutive slice
+    int *fixCounts;
+    bool *dirtyFlags;
+    pthread_mutex_t writerLock; //guards writer, the writer waits on it
+    struct backgroundWriter *writer; //NULL unless startBackgroundWriter was called
+    struct readAhead readAhead;
+};
+
+/**********************************************************************************
+ * Frame budget
+ *
+ * With setFrameBudget on, the pools opened draw their frames from one budget
+ * instead of holding numPages frames each: numPages only caps a pool. Every
+ * shard has a share of the budget. A frame is charged to it the first time
+ * the shard uses it, and parked again, its memory handed back to the system,
+ * when rebalancing moves it to another shard. A shard always keeps
+ * minFrames; committedFrames, the frames charged or kept for minimums, never
+ * exceeds maxFrames.
+ *
+ * Each share remembers the pages its shard evicted lately (ghosts). A miss
+ * on a ghost is a miss the shard would have hit with more frames. Every
+ * BUDGET_REBALANCE_MISSES misses the shard with the most ghost hits gets
+ * frames from the shard with the fewest (rebalanceFrameBudget).
+ ***********************************************************************************/
+
+#define BUDGET_REBALANCE_MISSES 64 //misses of the budget's shards between two rebalances
+#define BUDGET_STEP_DIVISOR 8 //a rebalance moves up to a donor's cap / BUDGET_STEP_DIVISOR frames
+
+struct frameBudget { //frames shared by the pools opened while setFrameBudget is on
+    int maxFrames;
+    int committedFrames; //sum of max(charged, minFrames) over the shares
+    int misses; //misses of the budget's shards since the last rebalance
+    pthread_mutex_t lock; //guards shares and rebalancing
+    struct budgetShare *shares; //every shard drawing from the budget
+};
 
+struct budgetShare { //a shard's part of the frame budget, guarded by the shard's poolLock
+    struct frameBudget *budget;
+    struct queuePool *shard;
+    struct budgetShare *next;
+    int target; //frames the shard may grow to, moved by rebalancing
+    int charged; //frames the shard holds memory for: used and not parked
+    int minFrames; //kept for the shard whatever the others need
+    int *parkedFrames; //stack of frames whose memory went back to the system
+    int numParked;
+    bool *parked;
+    struct hash *ghostIndex; //page number to ghost slot
+    PageNumber *ghostPages; //pages evicted lately, a ring with the oldest at ghostNext
+    int ghostSlots, ghostNext;
+    int ghostHits; //misses since the last rebalance that hit a ghost
+    int score; //ghost hits of the last period, for rebalanceFrameBudget
+};
+
+struct linkList {
+    int head, tail; //head is the most recently used end
+    int size;
+};
+
+struct listState { //FIFO and LRU
+    struct linkList order;
+    int *prev, *next;
+};
+
+struct clockState { //CLOCK and RS_CLOCK_LOCKFREE, the latter only touches it with atomics
+    unsigned int hand; //frame number the clock hand points at, modulo the number of frames
+    char *refBit; //reference bit of every frame
+};
+
+struct lfuBucket {
+    int count; //use count shared by every frame in the bucket
+    int head, tail; //frames of the bucket, most recently admitted first
+    int prev, next; //neighbouring buckets, ordered by increasing count
+};
+
+struct lfuState {
+    bool aging;
+    int lowest; //bucket with the smallest count, LIST_NONE when no page is loaded
+    int freeBucket; //stack of unused buckets linked through next
+    struct lfuBucket *buckets; //one bucket per frame plus a spare, there are never more distinct counts
+    int *bucketOf; //bucket of every frame
+    int *framePrev, *frameNext; //frame links inside a bucket
+    int inflation; //smallest count at the last eviction, used by aging
+};
+
+#define LRU_K_DEFAULT 2
+
+struct lruKState {
+    int k;
+    long now; //logical time, advanced on every reference
+    long *hist; //last k reference times of every frame, newest first, 0 when unused
+    int *heap; //loaded frames, the frame with the largest backward k-distance on top
+    int *heapPos; //position of every frame in heap, LIST_NONE when not loaded
+    int heapSize;
+    int *stash; //pinned frames taken off the heap while looking for a victim
+    int historySize; //retained history of evicted pages, replaced in FIFO order
+    int historyNext;
+    PageNumber *historyPage;
+    long *historyTimes;
+    struct hash *historyIndex; //page number to retained history entry
+};
+
+#define ADAPTIVE_RECENT 0 //ARC T1/B1, 2Q A1in/A1out
+#define ADAPTIVE_FREQUENT 1 //ARC T2/B2, 2Q Am and its ghosts
+
+struct adaptiveState {
+    int capacity; //frames in the pool
+    int target; //ARC: target size p of T1, 2Q: target size Kin of A1in
+    struct linkList resident[2];
+    int *frameList, *framePrev, *frameNext; //resident list of every frame
+    struct linkList ghost[2]; //page numbers recently evicted from the resident lists
+    int freeGhost; //stack of unused ghost slots linked through ghostNext
+    PageNumber *ghostPage;
+    int *ghostList, *ghostPrev, *ghostNext;
+    struct hash *ghostIndex; //page number to ghost slot
+    int pendingGhost; //ghost list the page being loaded was found in, LIST_NONE if none
+    bool keepGhost; //false when ARC drops the next victim without a ghost
+};
+
+struct hashSlot {
+    int pageNumber;
+    int value; //frame number in the page table
 };
 
 struct hash {
     int capacity;
-    struct DLnode * *pageTable;
+    int mask;
+    struct hashSlot *pageTable;
 };
 
 /**********************************************************************************
- * Function Name: checkSpaceAvailable
+ * Function Name: createHashTable
  *
  * Description:
- *      checkSpaceAvailable function is used to check the space in the buffer
- *
- * Return:
- *      RC Name                      Value                   Comment:
- *      RC_OK                               0                        Process successful
- *
- * Author: Devika beniwal
- *
- *
- *
+ *      allocates an open addressing table for up to totalEntries page numbers
  *
  ***********************************************************************************/
 
-int checkSpaceAvailable(struct queuePool *queuePool) {
-    if (queuePool->occupiedFrames == queuePool->totalNumFrames) {
-        return 0;
-    } else {
-        return 1;
+struct hash * createHashTable(int totalEntries) {
+    struct hash *temp = (struct hash *) malloc(sizeof (struct hash));
+    temp->capacity = 1;
+    while (temp->capacity < 2 * totalEntries) { //keep the load factor at or below one half
+        temp->capacity <<= 1;
     }
+    temp->mask = temp->capacity - 1;
+    temp->pageTable = (struct hashSlot *) malloc(temp->capacity * sizeof (struct hashSlot));
+    int i;
+    for (i = 0; i < temp->capacity; ++i) {
+        temp->pageTable[i].pageNumber = HASH_EMPTY_SLOT;
+        temp->pageTable[i].value = HASH_EMPTY_SLOT;
+    }
+
+    return temp;
+}
+
+void freeHashTable(struct hash *hash) {
+    free(hash->pageTable);
+    free(hash);
 }
 
 /**********************************************************************************
- * Function Name: createnode
- *
- *
- * Return:
- *      RC Name                      Value                   Comment:
- *      RC_OK                               0                        Process successful
- *
- * Author: Devika beniwal
- *
- *
+ * Function Name: hashIndex
  *
+ * Description:
+ *      returns the home slot of a page number in the open addressing page table.
+ *      The page number is mixed first so that consecutive pages spread out.
  *
  ***********************************************************************************/
-struct DLnode * createnode(const PageNumber pageNum) {
 
-    struct DLnode *newnode = (struct DLnode *) malloc(sizeof (struct DLnode *));
-    newnode->next = NULL;
-    newnode->prev = NULL;
-    newnode->pageNumber = pageNum;
-    newnode->frameNum = 0;
-    newnode->fixcount = 1;
-    newnode->dirty = 0;
-    newnode->data = calloc(PAGE_SIZE, sizeof (SM_PageHandle));
-    return newnode;
-};
+static inline int hashIndex(struct hash *hash, const PageNumber pageNum) {
+    unsigned int key = (unsigned int) pageNum;
+    key = (key ^ (key >> 16)) * 0x45d9f3bu;
+    key = key ^ (key >> 16);
+    return (int) (key & (unsigned int) hash->mask);
+}
 
 /**********************************************************************************
- * Function Name: findTheNode
- *
- * Return:
- *      RC Name                      Value                   Comment:
- *      RC_OK                               0                        Process successful
- *
- * Author: Devika beniwal
+ * Function Name: hashLookup
  *
+ * Description:
+ *      returns the value stored for pageNum, or HASH_EMPTY_SLOT when the page
+ *      is not in the table. Linear probing stops at the first empty slot.
  *
+ ***********************************************************************************/
+
+int hashLookup(struct hash *hash, const PageNumber pageNum) {
+    int i = hashIndex(hash, pageNum);
+    while (hash->pageTable[i].pageNumber != HASH_EMPTY_SLOT) {
+        if (hash->pageTable[i].pageNumber == pageNum) {
+            return hash->pageTable[i].value;
+        }
+        i = (i + 1) & hash->mask;
+    }
+    return HASH_EMPTY_SLOT;
+}
+
+/**********************************************************************************
+ * Function Name: hashInsert
  *
+ * Description:
+ *      maps pageNum to value, replacing an existing mapping. The table holds at
+ *      least twice as many slots as entries so it never fills.
  *
  ***********************************************************************************/
 
-struct DLnode * findTheNode(struct queuePool *queuePool, const PageNumber pageNum) {
+void hashInsert(struct hash *hash, const PageNumber pageNum, int value) {
+    int i = hashIndex(hash, pageNum);
+    while (hash->pageTable[i].pageNumber != HASH_EMPTY_SLOT && hash->pageTable[i].pageNumber != pageNum) {
+        i = (i + 1) & hash->mask;
+    }
+    hash->pageTable[i].pageNumber = pageNum;
+    hash->pageTable[i].value = value;
+}
 
-    struct DLnode *temp = queuePool->front;
+/**********************************************************************************
+ * Function Name: hashRemove
+ *
+ * Description:
+ *      removes the mapping of pageNum. Entries after the hole are shifted back
+ *      (backward shift deletion) so lookups never need tombstones.
+ *
+ ***********************************************************************************/
 
-    while (temp != NULL) {
-        if (temp->pageNumber == pageNum) {
-            return temp;
+void hashRemove(struct hash *hash, const PageNumber pageNum) {
+    int i = hashIndex(hash, pageNum);
+    while (hash->pageTable[i].pageNumber != pageNum) {
+        if (hash->pageTable[i].pageNumber == HASH_EMPTY_SLOT) {
+            return;
         }
-        temp = temp->next;
+        i = (i + 1) & hash->mask;
     }
-    return NULL;
+    int hole = i;
+    int j = i;
+    while (1) {
+        j = (j + 1) & hash->mask;
+        if (hash->pageTable[j].pageNumber == HASH_EMPTY_SLOT) {
+            break;
+        }
+        int home = hashIndex(hash, hash->pageTable[j].pageNumber);
+        // the entry at j may fill the hole only if its home slot is not in (hole, j]
+        if (((j - home) & hash->mask) >= ((j - hole) & hash->mask)) {
+            hash->pageTable[hole] = hash->pageTable[j];
+            hole = j;
+        }
+    }
+    hash->pageTable[hole].pageNumber = HASH_EMPTY_SLOT;
+    hash->pageTable[hole].value = HASH_EMPTY_SLOT;
 }
 
 /**********************************************************************************
- * Function Name: moveNodeToFront
+ * Function Name: checkSpaceAvailable
  *
+ * Description:
+ *      checkSpaceAvailable function is used to check the space in the buffer
  *
  * Return:
  *      RC Name                      Value                   Comment:
@@ -130,154 +406,408 @@ struct DLnode * findTheNode(struct queuePool *queuePool, const PageNumber pageNu
  *
  *
  ***********************************************************************************/
-void moveNodeToFront(struct DLnode *reqPage, struct queuePool **queuePool) {
-    struct DLnode* prevnode = reqPage->prev;
-    struct DLnode* nextnode = reqPage->next;
 
-    if (reqPage == (*queuePool)->front) {
-        return;
+int checkSpaceAvailable(struct queuePool *queuePool) {
+    if (__atomic_load_n(&queuePool->occupiedFrames, __ATOMIC_RELAXED) == queuePool->totalNumFrames) {
+        return 0;
+    } else {
+        return 1;
     }
+}
 
-    reqPage->prev->next = nextnode;
-    if (reqPage->next) {
-        reqPage->next->prev = prevnode;
+//claims the next frame never used yet, LIST_NONE once every frame was used
+static int claimFreeFrame(struct queuePool *queuePool) {
+    int used = __atomic_load_n(&queuePool->occupiedFrames, __ATOMIC_RELAXED);
+    while (used < queuePool->totalNumFrames) {
+        if (__atomic_compare_exchange_n(&queuePool->occupiedFrames, &used, used + 1, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            return used;
+        }
     }
+    return LIST_NONE;
+}
 
-    if (reqPage == (*queuePool)->rear) {
-        (*queuePool)->rear = prevnode;
-        (*queuePool)->rear->next = NULL;
+//the poolLock around the strategy of a shard, skipped by the strategies that need none
+static inline void lockStrategy(struct queuePool *queuePool) {
+    if (queuePool->strategy != RS_CLOCK_LOCKFREE || queuePool->share != NULL) {
+        pthread_mutex_lock(&queuePool->poolLock);
     }
-    reqPage->next = (*queuePool)->front;
-    reqPage->prev = NULL;
-    reqPage->next->prev = reqPage;
-    (*queuePool)->front = reqPage;
+}
 
+static inline void unlockStrategy(struct queuePool *queuePool) {
+    if (queuePool->strategy != RS_CLOCK_LOCKFREE || queuePool->share != NULL) {
+        pthread_mutex_unlock(&queuePool->poolLock);
+    }
 }
 
-/**********************************************************************************
- * Function Name: changeDLnodeContent
- *
- * Description:
- *      will update the node with the new requested data 
- *
- * Return:
- *      RC Name                      Value                   Comment:
- *      RC_OK                               0                        Process successful
- *
- * Author: Devika beniwal
- *
- *
- *
- *
- ***********************************************************************************/
+//TRUE for the frames a strategy may hand out: used before, not parked by the frame budget and not in a bulk ring
+static inline bool frameInUse(struct queuePool *queuePool, int frame) {
+    return frame < __atomic_load_n(&queuePool->occupiedFrames, __ATOMIC_RELAXED)
+            && (queuePool->share == NULL || !queuePool->share->parked[frame])
+            && !__atomic_load_n(&queuePool->ringFrames[frame], __ATOMIC_RELAXED);
+}
 
-RC changeDLnodeContent(BM_BufferPool * const bm, struct DLnode *reqPage, BM_PageHandle * const page, const PageNumber pageNum) { //will update the content of each node 
+struct budgetShare * createBudgetShare(struct frameBudget *budget, struct queuePool *shard, int minFrames) {
+    struct budgetShare *share = malloc(sizeof (struct budgetShare));
+    int i;
+    share->budget = budget;
+    share->shard = shard;
+    share->next = NULL;
+    share->target = shard->totalNumFrames; //free to grow until the budget runs out
+    share->charged = 0;
+    share->minFrames = (minFrames < shard->totalNumFrames) ? minFrames : shard->totalNumFrames;
+    share->parkedFrames = malloc(shard->totalNumFrames * sizeof (int));
+    share->numParked = 0;
+    share->parked = calloc(shard->totalNumFrames, sizeof (bool));
+    share->ghostSlots = (shard->totalNumFrames / 4 > minFrames) ? shard->totalNumFrames / 4 : minFrames;
+    share->ghostIndex = createHashTable(share->ghostSlots);
+    share->ghostPages = malloc(share->ghostSlots * sizeof (PageNumber));
+    for (i = 0; i < share->ghostSlots; i++) {
+        share->ghostPages[i] = NO_PAGE;
+    }
+    share->ghostNext = 0;
+    share->ghostHits = 0;
+    share->score = 0;
+    return share;
+}
 
-    struct queuePool *queuePool = bm->mgmtData;
-    struct hash *hash = bm->pageTableData;
-    SM_FileHandle fhandle;
+void freeBudgetShare(struct budgetShare *share) {
+    freeHashTable(share->ghostIndex);
+    free(share->ghostPages);
+    free(share->parkedFrames);
+    free(share->parked);
+    free(share);
+}
 
-    if (openPageFile((char *) (bm->pageFile), &fhandle) != RC_OK) {
-        return RC_FILE_NOT_FOUND;
+//charges one more frame to a share, FALSE when the budget has no room. The minimum is always there.
+static bool chargeFrame(struct budgetShare *share) {
+    if (share->charged >= share->minFrames) {
+        int committed = __atomic_load_n(&share->budget->committedFrames, __ATOMIC_RELAXED);
+        do {
+            if (committed >= share->budget->maxFrames) {
+                return FALSE;
+            }
+        } while (!__atomic_compare_exchange_n(&share->budget->committedFrames, &committed, committed + 1, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
     }
-    if (reqPage->dirty == 1) {
-        if ((ensureCapacity(pageNum, &fhandle)) != RC_OK) {
-            return RC_ENSURE_CAP_ERROR;
-        }
-        if ((writeBlock(reqPage->pageNumber, &fhandle, reqPage->data)) != RC_OK) { //when page is dirty writing the contents back to the disk
-            return RC_WRITE_FAILED;
-        }
-        queuePool->numWrite++;
+    __atomic_store_n(&share->charged, share->charged + 1, __ATOMIC_RELAXED); //read by rebalancing without the lock
+    return TRUE;
+}
+
+static void releaseFrame(struct budgetShare *share) {
+    __atomic_store_n(&share->charged, share->charged - 1, __ATOMIC_RELAXED);
+    if (share->charged >= share->minFrames) {
+        __atomic_sub_fetch(&share->budget->committedFrames, 1, __ATOMIC_RELAXED);
     }
+}
 
-    hash->pageTable[pageNum] = reqPage; //updating the address of the page number in the hash table
+//frames a shard can still grow by: frames never used or parked, as far as its target and the budget allow
+static int growableFrames(struct queuePool *queuePool) {
+    struct budgetShare *share = queuePool->share;
+    int unused = queuePool->totalNumFrames - __atomic_load_n(&queuePool->occupiedFrames, __ATOMIC_RELAXED);
+    if (share == NULL) {
+        return unused;
+    }
+    int room = __atomic_load_n(&share->target, __ATOMIC_RELAXED) - share->charged;
+    int budgetRoom = share->budget->maxFrames - __atomic_load_n(&share->budget->committedFrames, __ATOMIC_RELAXED)
+            + ((share->minFrames > share->charged) ? share->minFrames - share->charged : 0);
+    unused += share->numParked;
+    unused = (room < unused) ? room : unused;
+    unused = (budgetRoom < unused) ? budgetRoom : unused;
+    return (unused > 0) ? unused : 0;
+}
 
-    if ((ensureCapacity(pageNum, &fhandle)) != RC_OK) {
-        return RC_ENSURE_CAP_ERROR;
+//a frame for the shard to grow into, LIST_NONE when it is at its target, out of frames or the budget
+//is used up. A parked frame comes first. With overTarget the target doesn't count, the budget does.
+static int growFrame(struct queuePool *queuePool, bool overTarget) {
+    struct budgetShare *share = queuePool->share;
+    int frame;
+    if (share == NULL) {
+        return claimFreeFrame(queuePool);
+    }
+    if ((!overTarget && share->charged >= __atomic_load_n(&share->target, __ATOMIC_RELAXED))
+            || (share->numParked == 0 && !checkSpaceAvailable(queuePool))
+            || !chargeFrame(share)) {
+        return LIST_NONE;
     }
+    if (share->numParked > 0) {
+        frame = share->parkedFrames[--share->numParked];
+        share->parked[frame] = FALSE;
+    } else {
+        frame = claimFreeFrame(queuePool);
+    }
+    return frame;
+}
 
-    if ((readBlock(pageNum, &fhandle, reqPage->data)) != RC_OK) { //read the block from disk
-        return RC_READ_NON_EXISTING_PAGE;
+//remembers a page the shard evicted
+static void addBudgetGhost(struct queuePool *queuePool, const PageNumber pageNum) {
+    struct budgetShare *share = queuePool->share;
+    if (share == NULL) {
+        return;
     }
+    int slot = share->ghostNext;
+    int old = hashLookup(share->ghostIndex, pageNum);
+    if (old != HASH_EMPTY_SLOT) {
+        share->ghostPages[old] = NO_PAGE;
+    }
+    if (share->ghostPages[slot] != NO_PAGE) {
+        hashRemove(share->ghostIndex, share->ghostPages[slot]); //the oldest ghost is forgotten
+    }
+    share->ghostPages[slot] = pageNum;
+    hashInsert(share->ghostIndex, pageNum, slot);
+    share->ghostNext = (slot + 1) % share->ghostSlots;
+}
 
-    queuePool->numRead++;
-    reqPage->dirty = 0;
-    reqPage->fixcount++;
-    reqPage->pageNumber = pageNum;
-    page->pageNum = pageNum;
-    page->data = reqPage->data;
+//counts a miss on a page the shard evicted lately
+static void budgetMiss(struct queuePool *queuePool, const PageNumber pageNum) {
+    struct budgetShare *share = queuePool->share;
+    if (share == NULL) {
+        return;
+    }
+    __atomic_add_fetch(&share->budget->misses, 1, __ATOMIC_RELAXED);
+    int slot = hashLookup(share->ghostIndex, pageNum);
+    if (slot != HASH_EMPTY_SLOT) {
+        hashRemove(share->ghostIndex, pageNum);
+        share->ghostPages[slot] = NO_PAGE;
+        __atomic_add_fetch(&share->ghostHits, 1, __ATOMIC_RELAXED);
+    }
+}
 
-    closePageFile(&fhandle);
-    return RC_OK;
+//start of the data of a frame inside the slab
+static inline char * frameDataOf(struct queuePool *queuePool, int frame) {
+    return queuePool->frameData + (size_t) frame * queuePool->pageSize;
+}
+
+static inline int fixCountOf(struct queuePool *queuePool, int frame) {
+    return __atomic_load_n(&queuePool->fixCounts[frame], __ATOMIC_RELAXED);
+}
+
+static inline bool frameIsDirty(struct queuePool *queuePool, int frame) {
+    return __atomic_load_n(&queuePool->dirtyFlags[frame], __ATOMIC_ACQUIRE);
+}
+
+//sets the dirty flag of a frame and keeps dirtyFrames in step, TRUE when the flag changed
+static inline bool setFrameDirty(struct queuePool *queuePool, int frame, bool dirty) {
+    if (__atomic_exchange_n(&queuePool->dirtyFlags[frame], dirty, __ATOMIC_ACQ_REL) == dirty) {
+        return FALSE;
+    }
+    __atomic_add_fetch(&queuePool->dirtyFrames, dirty ? 1 : -1, __ATOMIC_RELAXED);
+    return TRUE;
+}
 
+//marks a frame dirty for markDirty. The version moves first, so a write-back under way sees the change in endWriteBack.
+static inline bool markFrameDirty(struct queuePool *queuePool, int frame) {
+    __atomic_add_fetch(&queuePool->dirtyVersions[frame], 2, __ATOMIC_ACQ_REL);
+    return setFrameDirty(queuePool, frame, TRUE);
+}
+
+//claims the write-back of a dirty frame, FALSE when it is clean or another thread is writing it back.
+//*version is handed to endWriteBack.
+static inline bool beginWriteBack(struct queuePool *queuePool, int frame, unsigned int *version) {
+    unsigned int current = __atomic_load_n(&queuePool->dirtyVersions[frame], __ATOMIC_ACQUIRE);
+    do {
+        if ((current & 1) || !frameIsDirty(queuePool, frame)) {
+            return FALSE;
+        }
+    } while (!__atomic_compare_exchange_n(&queuePool->dirtyVersions[frame], &current, current | 1, TRUE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    *version = current | 1;
+    return TRUE;
+}
+
+//ends a write-back. Once the page is written its flag is cleared, unless a markDirty came since beginWriteBack.
+static inline void endWriteBack(struct queuePool *queuePool, int frame, unsigned int version, bool written) {
+    if (written) {
+        setFrameDirty(queuePool, frame, FALSE);
+        if (__atomic_load_n(&queuePool->dirtyVersions[frame], __ATOMIC_ACQUIRE) != version) { //changed during the write
+            setFrameDirty(queuePool, frame, TRUE);
+        }
+    }
+    __atomic_sub_fetch(&queuePool->dirtyVersions[frame], 1, __ATOMIC_RELEASE);
 }
 
 /**********************************************************************************
- * Function Name: pinPageWithFIFO
- *
- * Description:
- *      will execute the first in first out page replacement method
- *
- * Return:
- *      RC Name                      Value                   Comment:
- *      RC_OK                               0                        Process successful
- *
- * Author: Damini Ganesh
- *
- *
+ * Page latches
  *
+ * A latch is one word: the number of readers, LATCH_EXCLUSIVE while a writer
+ * holds it and LATCH_WRITER_WAITING while a writer waits for the readers to
+ * leave. A waiting writer keeps new readers out, so a stream of readers can't
+ * starve it. Taking the latch shared is a single fetch-and-add when no writer
+ * is around, and every latch has a cache line to itself, so readers of
+ * different pages never touch the same line. Latches are held for short
+ * stretches of work on a page, waiters spin and then yield.
  *
+ * The version of a latch counts the writers: taking the latch exclusive makes
+ * it odd, releasing it even again, and a frame changing its page moves it on
+ * by two. A reader that saw the same even version before and after reading
+ * the frame read a page no writer touched meanwhile.
  ***********************************************************************************/
 
-RC pinPageWithFIFO(BM_BufferPool * const bm, BM_PageHandle * const page, const PageNumber pageNum) {
-    struct DLnode *reqPage;
-    struct queuePool *queuePool = bm->mgmtData;
-    struct hash *hash = bm->pageTableData;
-    reqPage = hash->pageTable[pageNum]; //check if the page is in the hash table or not!
+#define LATCH_EXCLUSIVE 0x40000000
+#define LATCH_WRITER_WAITING 0x20000000
+#define LATCH_READERS 0x1fffffff
+#define LATCH_SPINS 64 //spins before a waiter yields the CPU
 
-    if (reqPage != NULL) {
-        reqPage = findTheNode(queuePool, pageNum); //if exist find the address of the node
-        if (reqPage != NULL) {
-            page->pageNum = pageNum;
-            page->data = reqPage->data;
-            reqPage->fixcount++;
-            return RC_OK;
+static inline void latchBackoff(int *spins) {
+    if (++(*spins) >= LATCH_SPINS) {
+        sched_yield();
+        *spins = 0;
+    }
+}
+
+static void latchShared(struct pageLatch *latch) {
+    int spins = 0;
+    while (__atomic_fetch_add(&latch->state, 1, __ATOMIC_ACQUIRE) & (LATCH_EXCLUSIVE | LATCH_WRITER_WAITING)) {
+        __atomic_fetch_sub(&latch->state, 1, __ATOMIC_RELAXED); //a writer holds it or waits, step back
+        while (__atomic_load_n(&latch->state, __ATOMIC_RELAXED) & (LATCH_EXCLUSIVE | LATCH_WRITER_WAITING)) {
+            latchBackoff(&spins);
         }
-    } else {
-        if (checkSpaceAvailable(queuePool)) { //if occupied frames are less than the total number of frames ->space exist
-            reqPage = queuePool->front;
-            int i = 0;
-            while (i < queuePool->occupiedFrames) {
-                reqPage = reqPage->next;
-                i++;
-            }
-            queuePool->occupiedFrames++;
-        } else {
-            reqPage = queuePool->rear;
-            while (reqPage != NULL && reqPage->fixcount != 0) {
-                reqPage = reqPage->prev;
+    }
+}
+
+static void latchExclusive(struct pageLatch *latch) {
+    int spins = 0;
+    int state = __atomic_load_n(&latch->state, __ATOMIC_RELAXED);
+    while (1) {
+        if ((state & (LATCH_EXCLUSIVE | LATCH_READERS)) == 0) { //clears the waiting bit, other waiting writers set it again
+            if (__atomic_compare_exchange_n(&latch->state, &state, LATCH_EXCLUSIVE, TRUE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                __atomic_add_fetch(&latch->version, 1, __ATOMIC_ACQ_REL); //odd before the first change to the page
+                return;
             }
+            continue;
         }
-        moveNodeToFront(reqPage, &queuePool);
-        if (changeDLnodeContent(bm, reqPage, page, pageNum) != RC_OK) { //update the content of the node
-            return UPDATE_FRAME_ISSUE;
+        if (!(state & LATCH_WRITER_WAITING)) {
+            __atomic_fetch_or(&latch->state, LATCH_WRITER_WAITING, __ATOMIC_RELAXED);
         }
-        bm->mgmtData = queuePool;
-        bm->pageTableData = hash;
-        return RC_OK;
+        latchBackoff(&spins);
+        state = __atomic_load_n(&latch->state, __ATOMIC_RELAXED);
     }
-    return RC_OK;
+}
+
+//releases the latch in the mode it is held in, the holder of an exclusive latch is the only one
+static void latchRelease(struct pageLatch *latch) {
+    if (__atomic_load_n(&latch->state, __ATOMIC_RELAXED) & LATCH_EXCLUSIVE) {
+        __atomic_add_fetch(&latch->version, 1, __ATOMIC_RELEASE);
+        __atomic_fetch_and(&latch->state, ~LATCH_EXCLUSIVE, __ATOMIC_RELEASE);
+    } else {
+        __atomic_fetch_sub(&latch->state, 1, __ATOMIC_RELEASE);
+    }
+}
+
+//TRUE while readers hold the latch of a frame and no writer does
+static inline bool latchHeldShared(struct queuePool *queuePool, int frame) {
+    int state = __atomic_load_n(&queuePool->pageLatches[frame].state, __ATOMIC_RELAXED);
+    return !(state & LATCH_EXCLUSIVE) && (state & LATCH_READERS) > 0;
+}
+
+/**********************************************************************************
+ * Page table
+ *
+ * Maps the pages of the pool to their frames. It is a chained hash table
+ * whose chains run through the frames themselves, one link per frame, so it
+ * never allocates and never fills up. The buckets are split into
+ * PAGE_TABLE_STRIPES stripes with a lock each, so lookups of different pages
+ * seldom meet on one lock. A frame found under the stripe lock can be pinned
+ * before the lock is released: eviction removes a page under the same lock
+ * and only when its frame is unpinned.
+ ***********************************************************************************/
+
+#define PAGE_TABLE_STRIPES 64 //a power of two
+
+struct pageTableStripe {
+    pthread_mutex_t lock;
+} __attribute__((aligned(64))); //one cache line per lock
+
+struct pageTable {
+    struct pageTableStripe stripes[PAGE_TABLE_STRIPES];
+    int mask; //buckets - 1
+    int *buckets; //first frame of every chain
+    int *chainNext; //next frame of the chain, indexed by frame
+    PageNumber *keys; //page a frame is filed under
+};
+
+struct pageTable * createPageTable(int totalFrames) {
+    struct pageTable *table;
+    int buckets = PAGE_TABLE_STRIPES, i;
+    while (buckets < totalFrames) {
+        buckets <<= 1;
+    }
+    if (posix_memalign((void **) &table, 64, sizeof (struct pageTable)) != 0) {
+        return NULL;
+    }
+    for (i = 0; i < PAGE_TABLE_STRIPES; i++) {
+        pthread_mutex_init(&table->stripes[i].lock, NULL);
+    }
+    table->mask = buckets - 1;
+    table->buckets = malloc(buckets * sizeof (int));
+    table->chainNext = malloc(totalFrames * sizeof (int));
+    table->keys = malloc(totalFrames * sizeof (PageNumber));
+    for (i = 0; i < buckets; i++) {
+        table->buckets[i] = LIST_NONE;
+    }
+    return table;
+}
+
+void freePageTable(struct pageTable *table) {
+    int i;
+    for (i = 0; i < PAGE_TABLE_STRIPES; i++) {
+        pthread_mutex_destroy(&table->stripes[i].lock);
+    }
+    free(table->buckets);
+    free(table->chainNext);
+    free(table->keys);
+    free(table);
+}
+
+static inline int pageTableBucket(struct pageTable *table, const PageNumber pageNum) {
+    unsigned int key = (unsigned int) pageNum;
+    key = (key ^ (key >> 16)) * 0x45d9f3bu; //same mix as hashIndex
+    key = key ^ (key >> 16);
+    return (int) (key & (unsigned int) table->mask);
+}
+
+//locks the stripe of pageNum and returns its lock
+static inline pthread_mutex_t * pageTableLock(struct pageTable *table, const PageNumber pageNum) {
+    pthread_mutex_t *lock = &table->stripes[pageTableBucket(table, pageNum) & (PAGE_TABLE_STRIPES - 1)].lock;
+    pthread_mutex_lock(lock);
+    return lock;
+}
+
+//the lookup, insert and remove below are called with the stripe of pageNum locked
+
+static int pageTableLookup(struct pageTable *table, const PageNumber pageNum) {
+    int frame;
+    for (frame = table->buckets[pageTableBucket(table, pageNum)]; frame != LIST_NONE; frame = table->chainNext[frame]) {
+        if (table->keys[frame] == pageNum) {
+            return frame;
+        }
+    }
+    return LIST_NONE;
+}
+
+static void pageTableInsert(struct pageTable *table, const PageNumber pageNum, int frame) {
+    int bucket = pageTableBucket(table, pageNum);
+    table->keys[frame] = pageNum;
+    table->chainNext[frame] = table->buckets[bucket];
+    table->buckets[bucket] = frame;
+}
+
+static void pageTableRemove(struct pageTable *table, const PageNumber pageNum, int frame) {
+    int *link = &table->buckets[pageTableBucket(table, pageNum)];
+    while (*link != frame) {
+        link = &table->chainNext[*link];
+    }
+    *link = table->chainNext[frame];
 }
 
 /**********************************************************************************
- * Function Name: pinPageWithLRU
+ * Function Name: findTheFrame
  *
  * Description:
- *      will execute the least recently used page replacement method
+ *      finds the frame of a page through the page table in O(1). The frame
+ *      is not pinned, the answer only holds while the caller has the page
+ *      pinned itself.
  *
  * Return:
- *      RC Name                      Value                   Comment:
- *      RC_OK                               0                        Process successful
+ *      the frame number holding pageNum, LIST_NONE when the page is not in the
+ *      buffer pool
  *
  * Author: Devika beniwal
  *
@@ -286,61 +816,1412 @@ RC pinPageWithFIFO(BM_BufferPool * const bm, BM_PageHandle * const page, const P
  *
  ***********************************************************************************/
 
-int pinPageWithLRU(BM_BufferPool * const bm, BM_PageHandle * const page, const PageNumber pageNum) {
+int findTheFrame(struct queuePool *queuePool, const PageNumber pageNum) {
+    struct pageTable *table = queuePool->pageTable;
+    pthread_mutex_t *lock = pageTableLock(table, pageNum);
+    int frame = pageTableLookup(table, pageNum);
+    pthread_mutex_unlock(lock);
+    return frame;
+}
 
-    struct DLnode* reqPage;
-    struct queuePool *queuePool = bm->mgmtData;
-    struct hash *hash = bm->pageTableData;
-    reqPage = hash->pageTable[pageNum]; //check if the page is in the hash table or not
+/**********************************************************************************
+ * Read queue
+ *
+ * Misses read their pages through their shard's read queue. A miss next to
+ * none of the last pages read and to no run being read is on its own: it
+ * reads its page at once, noted among the recent pages, and the queue keeps
+ * nothing else of it. A miss next to one of them starts a run, as it may be
+ * part of a stream. A run waits while a run next to it is being read, and
+ * meanwhile the misses of the pages after it join it. So sessions walking
+ * the same new pages cost a readBlocks per run instead of a read per page,
+ * while misses far apart read side by side and take the queue lock once.
+ ***********************************************************************************/
 
-    if (reqPage != NULL) {
-        reqPage = findTheNode(queuePool, pageNum); //if exist find the address of the node
-        if (reqPage != NULL) {
-            page->pageNum = pageNum;
-            page->data = reqPage->data;
-            reqPage->fixcount++;
-            moveNodeToFront(reqPage, &queuePool); //the node whose contents have been changed is moved to the front
-            return RC_OK;
-        } else {
-            return PAGE_NODE_NOT_FOUND;
-        }
-    } else {
-        if (checkSpaceAvailable(queuePool)) { //if occupied frames are less than the total number of frames ->space exist
-            reqPage = queuePool->front;
-            int i = 0;
-            while (i < queuePool->occupiedFrames) {
-                reqPage = reqPage->next;
-                i++;
-            }
-            queuePool->occupiedFrames++;
-        } else { //replace the least recently used page 
+#define READ_MERGE_MAX_PAGES 64 //pages of one merged read
 
-            int selectedPage;
-            reqPage = queuePool->rear;
-            while (reqPage != NULL && reqPage->fixcount != 0) {
-                reqPage = reqPage->prev;
-            }
-            selectedPage = reqPage->pageNumber;
-            hash->pageTable[selectedPage] = NULL;
-            if (reqPage == NULL) {
-                return PAGE_NODE_NOT_FOUND;
-            }
+//the run pageNum would extend, NULL when there is none
+static struct readRun * findQueuedRun(struct readQueue *queue, const PageNumber pageNum) {
+    struct readRun *run;
+    for (run = queue->runs; run != NULL; run = run->next) {
+        if (!run->issued && run->count < READ_MERGE_MAX_PAGES
+                && (pageNum == run->first - 1 || pageNum == run->first + run->count)) {
+            return run;
         }
+    }
+    return NULL;
+}
 
-        if (changeDLnodeContent(bm, reqPage, page, pageNum) != RC_OK) { //update the content of the node 
-            return UPDATE_FRAME_ISSUE;
+//TRUE while a run next to mine is being read
+static bool neighbourReading(struct readQueue *queue, struct readRun *mine) {
+    struct readRun *run;
+    for (run = queue->runs; run != NULL; run = run->next) {
+        if (run->issued && run->first <= mine->first + mine->count && mine->first <= run->first + run->count) {
+            return TRUE;
         }
+    }
+    return FALSE;
+}
 
-        if (reqPage != queuePool->front) {
-            moveNodeToFront(reqPage, &queuePool); //the node whose contents have been changed is moved to the front
-        } else {
-            queuePool->front = queuePool->rear = reqPage;
+//TRUE when a page next to pageNum was read alone lately
+static bool neighbourRecent(struct readQueue *queue, const PageNumber pageNum) {
+    return (pageNum > 0 && queue->recent[(pageNum - 1) & (READ_RECENT_PAGES - 1)] == pageNum - 1)
+            || queue->recent[(pageNum + 1) & (READ_RECENT_PAGES - 1)] == pageNum + 1;
+}
 
+//reads page pageNum into data, merged with the misses of the pages next to it
+static RC queueRead(struct readQueue *queue, SM_FileHandle *fHandle, const PageNumber pageNum, char *data) {
+    struct queuedRead mine = {pageNum, data, RC_OK, FALSE, NULL};
+    struct readRun myRun = {pageNum, 1, FALSE, &mine, NULL};
+    struct readRun **link;
+    struct queuedRead *read;
+
+    pthread_mutex_lock(&queue->lock);
+    struct readRun *run = findQueuedRun(queue, pageNum);
+    if (run != NULL) { //read by the thread that started the run
+        mine.next = run->misses;
+        run->misses = &mine;
+        run->first = (pageNum < run->first) ? pageNum : run->first;
+        run->count++;
+        queue->waiting++;
+        while (!mine.finished) {
+            pthread_cond_wait(&queue->finished, &queue->lock);
         }
-        bm->mgmtData = queuePool;
-        bm->pageTableData = hash;
+        queue->waiting--;
+        pthread_mutex_unlock(&queue->lock);
+        return mine.rc;
+    }
+    if (!neighbourRecent(queue, pageNum) && !neighbourReading(queue, &myRun)) { //on its own
+        queue->recent[pageNum & (READ_RECENT_PAGES - 1)] = pageNum;
+        pthread_mutex_unlock(&queue->lock);
+        return readBlock(pageNum, fHandle, data);
+    }
+    myRun.next = queue->runs;
+    queue->runs = &myRun;
+    queue->waiting++;
+    while (neighbourReading(queue, &myRun)) {
+        pthread_cond_wait(&queue->finished, &queue->lock);
+    }
+    queue->waiting--;
+    myRun.issued = TRUE;
+    pthread_mutex_unlock(&queue->lock);
 
-        return RC_OK;
+    SM_PageHandle pages[READ_MERGE_MAX_PAGES];
+    for (read = myRun.misses; read != NULL; read = read->next) {
+        pages[read->pageNum - myRun.first] = read->data;
+    }
+    RC rc = (myRun.count == 1) ? readBlock(myRun.first, fHandle, pages[0])
+            : readBlocks(myRun.first, myRun.count, fHandle, pages);
+
+    pthread_mutex_lock(&queue->lock);
+    for (link = &queue->runs; *link != &myRun; link = &(*link)->next) {
+    }
+    *link = myRun.next;
+    for (read = myRun.misses; read != NULL; ) {
+        struct queuedRead *next = read->next; //read lives on the stack of its thread, gone once it sees finished
+        read->rc = rc;
+        read->finished = TRUE;
+        read = next;
+    }
+    if (myRun.count > 1) {
+        __atomic_add_fetch(&queue->numMerged, myRun.count - 1, __ATOMIC_RELAXED); //summed without the lock
+    }
+    if (queue->waiting > 0) {
+        pthread_cond_broadcast(&queue->finished);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return rc;
+}
+
+static void initReadQueue(struct readQueue *queue) {
+    int i;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->finished, NULL);
+    queue->runs = NULL;
+    for (i = 0; i < READ_RECENT_PAGES; i++) {
+        queue->recent[i] = NO_PAGE;
+    }
+    queue->waiting = 0;
+    queue->numMerged = 0;
+}
+
+static void destroyReadQueue(struct readQueue *queue) {
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->finished);
+}
+
+//takes a page whose read failed out of its frame, threads waiting for the page find the frame empty
+static void forgetFramePage(struct queuePool *queuePool, int frame, const PageNumber pageNum) {
+    lockStrategy(queuePool);
+    pthread_mutex_t *lock = pageTableLock(queuePool->pageTable, pageNum);
+    pageTableRemove(queuePool->pageTable, pageNum, frame);
+    __atomic_store_n(&queuePool->pageNumbers[frame], NO_PAGE, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(lock);
+    unlockStrategy(queuePool);
+}
+
+/**********************************************************************************
+ * Function Name: changeFrameContent
+ *
+ * Description:
+ *      reads the page a frame was just filed under into it. The caller has
+ *      the frame pinned and marked ioInProgress, and holds no lock. The frame is
+ *      left empty (NO_PAGE) when the page cannot be read.
+ *
+ * Return:
+ *      RC Name                      Value                   Comment:
+ *      RC_OK                               0                        Process successful
+ *
+ * Author: Devika beniwal
+ *
+ *
+ *
+ *
+ ***********************************************************************************/
+
+RC changeFrameContent(struct queuePool *queuePool, int frame, const PageNumber pageNum) { //will update the content of each frame
+
+    SM_FileHandle *fhandle = queuePool->fileHandle;
+    RC status = RC_OK;
+
+    if ((ensureCapacity(pageNum + 1, fhandle)) != RC_OK) { //pages 0 to pageNum have to exist
+        status = RC_ENSURE_CAP_ERROR;
+    } else if ((queueRead(&queuePool->reads, fhandle, pageNum, frameDataOf(queuePool, frame))) != RC_OK) { //read the block from disk
+        status = RC_READ_NON_EXISTING_PAGE;
+    }
+
+    if (status != RC_OK) {
+        forgetFramePage(queuePool, frame, pageNum);
+        return status;
+    }
+    __atomic_add_fetch(&queuePool->numRead, 1, __ATOMIC_RELAXED);
+    return RC_OK;
+
+}
+
+//links item at the most recently used end of list
+static void linkPushFront(struct linkList *list, int *prev, int *next, int item) {
+    prev[item] = LIST_NONE;
+    next[item] = list->head;
+    if (list->head != LIST_NONE) {
+        prev[list->head] = item;
+    } else {
+        list->tail = item;
+    }
+    list->head = item;
+    list->size++;
+}
+
+//links item at the least recently used end of list, next in line for eviction
+static void linkPushBack(struct linkList *list, int *prev, int *next, int item) {
+    next[item] = LIST_NONE;
+    prev[item] = list->tail;
+    if (list->tail != LIST_NONE) {
+        next[list->tail] = item;
+    } else {
+        list->head = item;
+    }
+    list->tail = item;
+    list->size++;
+}
+
+static void linkRemove(struct linkList *list, int *prev, int *next, int item) {
+    if (prev[item] != LIST_NONE) {
+        next[prev[item]] = next[item];
+    } else {
+        list->head = next[item];
+    }
+    if (next[item] != LIST_NONE) {
+        prev[next[item]] = prev[item];
+    } else {
+        list->tail = prev[item];
+    }
+    list->size--;
+}
+
+//returns the unpinned frame closest to the tail of a frame list, LIST_NONE if every frame is pinned
+static int linkUnpinnedFromTail(struct queuePool *queuePool, struct linkList *list, int *prev) {
+    int frame;
+    for (frame = list->tail; frame != LIST_NONE; frame = prev[frame]) {
+        if (fixCountOf(queuePool, frame) == 0) {
+            return frame;
+        }
+    }
+    return LIST_NONE;
+}
+
+struct listState * createListState(int totalFrames) {
+    struct listState *list = malloc(sizeof (struct listState));
+    list->order.head = list->order.tail = LIST_NONE;
+    list->order.size = 0;
+    list->prev = malloc(totalFrames * sizeof (int));
+    list->next = malloc(totalFrames * sizeof (int));
+    return list;
+}
+
+void freeListState(struct listState *list) {
+    free(list->prev);
+    free(list->next);
+    free(list);
+}
+
+/**********************************************************************************
+ * Function Name: listVictim
+ *
+ * Description:
+ *      first in first out and least recently used page replacement share one
+ *      frame list, newest frame at the head. The victim is the unpinned frame
+ *      closest to the tail. FIFO only links frames in when they are loaded,
+ *      LRU also moves a frame to the head on every hit (listHit).
+ *
+ * Return:
+ *      the frame to reuse, LIST_NONE when every frame is pinned
+ *
+ ***********************************************************************************/
+
+int listVictim(struct queuePool *queuePool, struct listState *list) {
+    int frame = linkUnpinnedFromTail(queuePool, &list->order, list->prev);
+    if (frame != LIST_NONE) {
+        linkRemove(&list->order, list->prev, list->next, frame);
+    }
+    return frame;
+}
+
+void listHit(struct listState *list, int frame) { //LRU, and FIFO on the first pin of a prefetched frame
+    linkRemove(&list->order, list->prev, list->next, frame);
+    linkPushFront(&list->order, list->prev, list->next, frame);
+}
+
+void listAdmit(struct listState *list, int frame) {
+    linkPushFront(&list->order, list->prev, list->next, frame);
+}
+
+/**********************************************************************************
+ * Function Name: createClockState
+ *
+ * Description:
+ *      allocates the reference bits and the hand used by the CLOCK strategy
+ *
+ ***********************************************************************************/
+
+struct clockState * createClockState(int totalFrames) {
+    struct clockState *clock = malloc(sizeof (struct clockState));
+    clock->hand = 0;
+    clock->refBit = calloc(totalFrames, sizeof (char));
+    return clock;
+}
+
+void freeClockState(struct clockState *clock) {
+    free(clock->refBit);
+    free(clock);
+}
+
+/**********************************************************************************
+ * Function Name: clockVictim
+ *
+ * Description:
+ *      will execute the clock (second chance) page replacement method.
+ *      A hit only sets the reference bit of the frame (clockHit). On a miss
+ *      the hand sweeps over the frames, skips pinned frames, clears set
+ *      reference bits and takes the first frame whose bit is already clear.
+ *
+ * Return:
+ *      the frame to reuse, LIST_NONE when every frame is pinned
+ *
+ ***********************************************************************************/
+
+int clockVictim(struct queuePool *queuePool, struct clockState *clock) {
+    int swept = 0;
+    int total = queuePool->totalNumFrames;
+    while (swept < 2 * total) { //two full turns clear every bit, so no victim means all frames are pinned
+        int candidate = clock->hand;
+        clock->hand = (clock->hand + 1) % total;
+        swept++;
+        if (fixCountOf(queuePool, candidate) > 0 || !frameInUse(queuePool, candidate)) {
+            continue;
+        }
+        if (clock->refBit[candidate]) {
+            clock->refBit[candidate] = 0;
+            continue;
+        }
+        return candidate;
+    }
+    return LIST_NONE;
+}
+
+void clockHit(struct clockState *clock, int frame) {
+    clock->refBit[frame] = 1; //give the page a second chance
+}
+
+/**********************************************************************************
+ * Function Name: lockFreeClockVictim
+ *
+ * Description:
+ *      CLOCK for pools pinned from many threads, run without the pool lock.
+ *      Every thread looking for a victim moves the shared hand on with a
+ *      fetch-and-add, so sweepers never visit the same frame at once, and
+ *      clears reference bits with an atomic exchange. The victim isn't
+ *      reserved here: takeFrame claims it with a compare-and-swap on its
+ *      fix count and asks for another one when a pin got there first.
+ *
+ * Return:
+ *      the frame to reuse, LIST_NONE when every frame is pinned
+ *
+ ***********************************************************************************/
+
+int lockFreeClockVictim(struct queuePool *queuePool, struct clockState *clock) {
+    int total = queuePool->totalNumFrames;
+    int swept;
+    for (swept = 0; swept < 2 * total; swept++) {
+        int candidate = __atomic_fetch_add(&clock->hand, 1, __ATOMIC_RELAXED) % total;
+        if (fixCountOf(queuePool, candidate) > 0 || !frameInUse(queuePool, candidate)) {
+            continue;
+        }
+        if (__atomic_load_n(&clock->refBit[candidate], __ATOMIC_RELAXED)
+                && __atomic_exchange_n(&clock->refBit[candidate], 0, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        return candidate;
+    }
+    return LIST_NONE;
+}
+
+//sets the reference bit of a frame, a bit that is already set isn't written so hits of a hot page share its line
+static inline void lockFreeClockMark(struct clockState *clock, int frame, char bit) {
+    if (__atomic_load_n(&clock->refBit[frame], __ATOMIC_RELAXED) != bit) {
+        __atomic_store_n(&clock->refBit[frame], bit, __ATOMIC_RELAXED);
+    }
+}
+
+/**********************************************************************************
+ * Function Name: createLFUState
+ *
+ * Description:
+ *      allocates the frequency buckets of the LFU strategy. Buckets and frame
+ *      links are kept in arrays indexed by bucket and frame number so that
+ *      pinning never allocates memory.
+ *
+ ***********************************************************************************/
+
+struct lfuState * createLFUState(int totalFrames, BM_LFUParams *params) {
+    struct lfuState *lfu = malloc(sizeof (struct lfuState));
+    int i;
+    lfu->aging = (params != NULL) ? params->aging : FALSE;
+    lfu->inflation = 0;
+    lfu->lowest = LIST_NONE;
+    lfu->buckets = malloc((totalFrames + 1) * sizeof (struct lfuBucket)); //an increment links the new bucket before the old one is released
+    lfu->bucketOf = malloc(totalFrames * sizeof (int));
+    lfu->framePrev = malloc(totalFrames * sizeof (int));
+    lfu->frameNext = malloc(totalFrames * sizeof (int));
+    for (i = 0; i <= totalFrames; i++) {
+        lfu->buckets[i].next = (i < totalFrames) ? i + 1 : LIST_NONE;
+    }
+    for (i = 0; i < totalFrames; i++) {
+        lfu->bucketOf[i] = LIST_NONE;
+    }
+    lfu->freeBucket = 0;
+    return lfu;
+}
+
+void freeLFUState(struct lfuState *lfu) {
+    free(lfu->buckets);
+    free(lfu->bucketOf);
+    free(lfu->framePrev);
+    free(lfu->frameNext);
+    free(lfu);
+}
+
+//creates an empty bucket for count and links it between the buckets prev and next
+static int lfuNewBucket(struct lfuState *lfu, int count, int prev, int next) {
+    int b = lfu->freeBucket;
+    lfu->freeBucket = lfu->buckets[b].next;
+    lfu->buckets[b].count = count;
+    lfu->buckets[b].head = lfu->buckets[b].tail = LIST_NONE;
+    lfu->buckets[b].prev = prev;
+    lfu->buckets[b].next = next;
+    if (prev != LIST_NONE) {
+        lfu->buckets[prev].next = b;
+    } else {
+        lfu->lowest = b;
+    }
+    if (next != LIST_NONE) {
+        lfu->buckets[next].prev = b;
+    }
+    return b;
+}
+
+//adds frame at the front of bucket b
+static void lfuPushFrame(struct lfuState *lfu, int b, int frame) {
+    struct lfuBucket *bucket = &lfu->buckets[b];
+    lfu->bucketOf[frame] = b;
+    lfu->framePrev[frame] = LIST_NONE;
+    lfu->frameNext[frame] = bucket->head;
+    if (bucket->head != LIST_NONE) {
+        lfu->framePrev[bucket->head] = frame;
+    } else {
+        bucket->tail = frame;
+    }
+    bucket->head = frame;
+}
+
+//unlinks frame from its bucket and releases the bucket once it is empty
+static void lfuRemoveFrame(struct lfuState *lfu, int frame) {
+    int b = lfu->bucketOf[frame];
+    struct lfuBucket *bucket = &lfu->buckets[b];
+    if (lfu->framePrev[frame] != LIST_NONE) {
+        lfu->frameNext[lfu->framePrev[frame]] = lfu->frameNext[frame];
+    } else {
+        bucket->head = lfu->frameNext[frame];
+    }
+    if (lfu->frameNext[frame] != LIST_NONE) {
+        lfu->framePrev[lfu->frameNext[frame]] = lfu->framePrev[frame];
+    } else {
+        bucket->tail = lfu->framePrev[frame];
+    }
+    lfu->bucketOf[frame] = LIST_NONE;
+    if (bucket->head == LIST_NONE) {
+        if (bucket->prev != LIST_NONE) {
+            lfu->buckets[bucket->prev].next = bucket->next;
+        } else {
+            lfu->lowest = bucket->next;
+        }
+        if (bucket->next != LIST_NONE) {
+            lfu->buckets[bucket->next].prev = bucket->prev;
+        }
+        bucket->next = lfu->freeBucket;
+        lfu->freeBucket = b;
+    }
+}
+
+/**********************************************************************************
+ * Function Name: lfuIncrement
+ *
+ * Description:
+ *      moves a frame from its bucket to the bucket holding count + 1, which is
+ *      always the next bucket or a new one linked right after it
+ *
+ ***********************************************************************************/
+
+void lfuIncrement(struct lfuState *lfu, int frame) {
+    int b = lfu->bucketOf[frame];
+    int count = lfu->buckets[b].count + 1;
+    int next = lfu->buckets[b].next;
+    int target;
+    if (next != LIST_NONE && lfu->buckets[next].count == count) {
+        target = next;
+    } else {
+        target = lfuNewBucket(lfu, count, b, next);
+    }
+    lfuRemoveFrame(lfu, frame);
+    lfuPushFrame(lfu, target, frame);
+}
+
+/**********************************************************************************
+ * Function Name: lfuAdmit
+ *
+ * Description:
+ *      adds a newly loaded frame. Without aging every page starts with count 1.
+ *      With aging (LFU with dynamic aging) a page starts one above the smallest
+ *      count in the pool, so counts collected long ago lose their weight as
+ *      newer pages catch up with them. Either way the target is the lowest
+ *      bucket or its successor, so admission stays O(1).
+ *
+ ***********************************************************************************/
+
+static int lfuAdmitBucket(struct lfuState *lfu) {
+    int count = 1 + (lfu->aging ? lfu->inflation : 0);
+    int prev = LIST_NONE;
+    int b = lfu->lowest;
+    if (b != LIST_NONE && lfu->buckets[b].count < count) {
+        prev = b;
+        b = lfu->buckets[b].next;
+    }
+    if (b == LIST_NONE || lfu->buckets[b].count != count) {
+        b = lfuNewBucket(lfu, count, prev, b);
+    }
+    return b;
+}
+
+void lfuAdmit(struct lfuState *lfu, int frame) {
+    lfuPushFrame(lfu, lfuAdmitBucket(lfu), frame);
+}
+
+//a prefetched frame waits at the eviction end of the admission bucket
+void lfuAdmitPrefetched(struct lfuState *lfu, int frame) {
+    int b = lfuAdmitBucket(lfu);
+    struct lfuBucket *bucket = &lfu->buckets[b];
+    lfu->bucketOf[frame] = b;
+    lfu->frameNext[frame] = LIST_NONE;
+    lfu->framePrev[frame] = bucket->tail;
+    if (bucket->tail != LIST_NONE) {
+        lfu->frameNext[bucket->tail] = frame;
+    } else {
+        bucket->head = frame;
+    }
+    bucket->tail = frame;
+}
+
+/**********************************************************************************
+ * Function Name: lfuVictim
+ *
+ * Description:
+ *      will execute the least frequently used page replacement method.
+ *      Frames are kept in buckets of equal use count, the buckets form a list
+ *      sorted by count. A hit moves the frame one bucket up (lfuIncrement),
+ *      the victim is the oldest unpinned frame of the lowest bucket.
+ *
+ * Return:
+ *      the frame to reuse, LIST_NONE when every frame is pinned
+ *
+ ***********************************************************************************/
+
+int lfuVictim(struct queuePool *queuePool, struct lfuState *lfu) {
+    int b, frame = LIST_NONE;
+    if (lfu->lowest == LIST_NONE) {
+        return LIST_NONE;
+    }
+    lfu->inflation = lfu->buckets[lfu->lowest].count;
+    for (b = lfu->lowest; b != LIST_NONE && frame == LIST_NONE; b = lfu->buckets[b].next) {
+        for (frame = lfu->buckets[b].tail; frame != LIST_NONE; frame = lfu->framePrev[frame]) {
+            if (fixCountOf(queuePool, frame) == 0) {
+                break;
+            }
+        }
+    }
+    if (frame != LIST_NONE) {
+        lfuRemoveFrame(lfu, frame);
+    }
+    return frame;
+}
+
+/**********************************************************************************
+ * Function Name: createLRUKState
+ *
+ * Description:
+ *      allocates the reference history, the victim heap and the retained
+ *      history of evicted pages of the LRU-K strategy. stratData may point to
+ *      an int holding K, K defaults to 2.
+ *
+ ***********************************************************************************/
+
+struct lruKState * createLRUKState(int totalFrames, int *k) {
+    struct lruKState *lruK = malloc(sizeof (struct lruKState));
+    int i;
+    lruK->k = (k != NULL && *k > 0) ? *k : LRU_K_DEFAULT;
+    lruK->now = 0;
+    lruK->hist = calloc(totalFrames * lruK->k, sizeof (long));
+    lruK->heap = malloc(totalFrames * sizeof (int));
+    lruK->heapPos = malloc(totalFrames * sizeof (int));
+    lruK->stash = malloc(totalFrames * sizeof (int));
+    lruK->heapSize = 0;
+    for (i = 0; i < totalFrames; i++) {
+        lruK->heapPos[i] = LIST_NONE;
+    }
+    lruK->historySize = totalFrames;
+    lruK->historyNext = 0;
+    lruK->historyPage = malloc(totalFrames * sizeof (PageNumber));
+    lruK->historyTimes = malloc(totalFrames * lruK->k * sizeof (long));
+    for (i = 0; i < totalFrames; i++) {
+        lruK->historyPage[i] = NO_PAGE;
+    }
+    lruK->historyIndex = createHashTable(totalFrames);
+    return lruK;
+}
+
+void freeLRUKState(struct lruKState *lruK) {
+    free(lruK->hist);
+    free(lruK->heap);
+    free(lruK->heapPos);
+    free(lruK->stash);
+    free(lruK->historyPage);
+    free(lruK->historyTimes);
+    freeHashTable(lruK->historyIndex);
+    free(lruK);
+}
+
+//true when frame a should be evicted before frame b
+static bool lruKBefore(struct lruKState *lruK, int a, int b) {
+    long *histA = &lruK->hist[a * lruK->k];
+    long *histB = &lruK->hist[b * lruK->k];
+    long kthA = histA[lruK->k - 1];
+    long kthB = histB[lruK->k - 1];
+    if ((kthA == 0) != (kthB == 0)) {
+        return kthA == 0; //fewer than k references means an infinite k-distance
+    }
+    if (kthA == 0) {
+        return histA[0] < histB[0]; //both infinite, fall back to plain LRU
+    }
+    return kthA < kthB;
+}
+
+static void lruKSwap(struct lruKState *lruK, int i, int j) {
+    int frame = lruK->heap[i];
+    lruK->heap[i] = lruK->heap[j];
+    lruK->heap[j] = frame;
+    lruK->heapPos[lruK->heap[i]] = i;
+    lruK->heapPos[lruK->heap[j]] = j;
+}
+
+static void lruKSiftUp(struct lruKState *lruK, int i) {
+    while (i > 0 && lruKBefore(lruK, lruK->heap[i], lruK->heap[(i - 1) / 2])) {
+        lruKSwap(lruK, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void lruKSiftDown(struct lruKState *lruK, int i) {
+    while (1) {
+        int first = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < lruK->heapSize && lruKBefore(lruK, lruK->heap[left], lruK->heap[first])) {
+            first = left;
+        }
+        if (right < lruK->heapSize && lruKBefore(lruK, lruK->heap[right], lruK->heap[first])) {
+            first = right;
+        }
+        if (first == i) {
+            return;
+        }
+        lruKSwap(lruK, i, first);
+        i = first;
+    }
+}
+
+static void lruKPush(struct lruKState *lruK, int frame) {
+    lruK->heap[lruK->heapSize] = frame;
+    lruK->heapPos[frame] = lruK->heapSize;
+    lruK->heapSize++;
+    lruKSiftUp(lruK, lruK->heapSize - 1);
+}
+
+static int lruKPop(struct lruKState *lruK) {
+    int frame = lruK->heap[0];
+    lruK->heapSize--;
+    if (lruK->heapSize > 0) {
+        lruKSwap(lruK, 0, lruK->heapSize);
+        lruKSiftDown(lruK, 0);
+    }
+    lruK->heapPos[frame] = LIST_NONE;
+    return frame;
+}
+
+//shifts the history of frame by one reference and records the current time
+static void lruKReference(struct lruKState *lruK, int frame) {
+    long *hist = &lruK->hist[frame * lruK->k];
+    memmove(hist + 1, hist, (lruK->k - 1) * sizeof (long));
+    hist[0] = ++lruK->now;
+}
+
+/**********************************************************************************
+ * Function Name: lruKRetain
+ *
+ * Description:
+ *      keeps the history of an evicted page so it is not lost when the page
+ *      comes back. The table is bounded, the oldest entry is overwritten.
+ *
+ ***********************************************************************************/
+
+void lruKRetain(struct lruKState *lruK, PageNumber pageNum, int frame) {
+    int entry = lruK->historyNext;
+    if (pageNum == NO_PAGE) {
+        return;
+    }
+    lruK->historyNext = (lruK->historyNext + 1) % lruK->historySize;
+    if (lruK->historyPage[entry] != NO_PAGE) {
+        hashRemove(lruK->historyIndex, lruK->historyPage[entry]);
+    }
+    lruK->historyPage[entry] = pageNum;
+    memcpy(&lruK->historyTimes[entry * lruK->k], &lruK->hist[frame * lruK->k], lruK->k * sizeof (long));
+    hashInsert(lruK->historyIndex, pageNum, entry);
+}
+
+//loads the retained history of pageNum into frame, or an empty history for a page never seen
+static void lruKRestore(struct lruKState *lruK, PageNumber pageNum, int frame) {
+    int entry = hashLookup(lruK->historyIndex, pageNum);
+    if (entry == HASH_EMPTY_SLOT) {
+        memset(&lruK->hist[frame * lruK->k], 0, lruK->k * sizeof (long));
+        return;
+    }
+    memcpy(&lruK->hist[frame * lruK->k], &lruK->historyTimes[entry * lruK->k], lruK->k * sizeof (long));
+    hashRemove(lruK->historyIndex, pageNum);
+    lruK->historyPage[entry] = NO_PAGE;
+}
+
+/**********************************************************************************
+ * Function Name: lruKVictim
+ *
+ * Description:
+ *      will execute the LRU-K page replacement method. The victim is the page
+ *      whose k-th most recent reference lies furthest back; pages referenced
+ *      fewer than k times go first, in LRU order. Loaded frames sit in a heap
+ *      ordered that way, so a hit costs O(log frames) and the victim is
+ *      normally the top of the heap. Only pinned frames on top are set aside.
+ *      The history of the victim is retained for when its page comes back.
+ *
+ * Return:
+ *      the frame to reuse, LIST_NONE when every frame is pinned
+ *
+ ***********************************************************************************/
+
+int lruKVictim(struct queuePool *queuePool, struct lruKState *lruK) {
+    int pinned = 0;
+    int victim = LIST_NONE;
+    int i;
+    while (lruK->heapSize > 0) {
+        int frame = lruKPop(lruK);
+        if (fixCountOf(queuePool, frame) == 0) {
+            victim = frame;
+            break;
+        }
+        lruK->stash[pinned++] = frame;
+    }
+    for (i = 0; i < pinned; i++) {
+        lruKPush(lruK, lruK->stash[i]);
+    }
+    if (victim != LIST_NONE) {
+        lruKRetain(lruK, queuePool->pageNumbers[victim], victim);
+    }
+    return victim;
+}
+
+void lruKHit(struct lruKState *lruK, int frame) {
+    lruKReference(lruK, frame);
+    lruKSiftDown(lruK, lruK->heapPos[frame]); //a new reference only moves a frame away from eviction
+}
+
+void lruKAdmit(struct lruKState *lruK, PageNumber pageNum, int frame) {
+    lruKRestore(lruK, pageNum, frame);
+    lruKReference(lruK, frame);
+    lruKPush(lruK, frame);
+}
+
+//no reference is recorded for a prefetched page, a page never seen before goes to the top of the heap
+void lruKAdmitPrefetched(struct lruKState *lruK, PageNumber pageNum, int frame) {
+    lruKRestore(lruK, pageNum, frame);
+    lruKPush(lruK, frame);
+}
+
+/**********************************************************************************
+ * Function Name: createAdaptiveState
+ *
+ * Description:
+ *      allocates the resident and ghost lists shared by ARC and 2Q. Lists are
+ *      linked through arrays indexed by frame number or ghost slot, so they
+ *      never allocate while pinning.
+ *
+ ***********************************************************************************/
+
+struct adaptiveState * createAdaptiveState(ReplacementStrategy strategy, int totalFrames) {
+    struct adaptiveState *state = malloc(sizeof (struct adaptiveState));
+    int ghostSlots = totalFrames + 1;
+    int i;
+    state->capacity = totalFrames;
+    state->target = (strategy == RS_2Q) ? (totalFrames + 3) / 4 : 0; //2Q starts from the paper's Kin of 25%
+    for (i = 0; i < 2; i++) {
+        state->resident[i].head = state->resident[i].tail = LIST_NONE;
+        state->resident[i].size = 0;
+        state->ghost[i].head = state->ghost[i].tail = LIST_NONE;
+        state->ghost[i].size = 0;
+    }
+    state->frameList = malloc(totalFrames * sizeof (int));
+    state->framePrev = malloc(totalFrames * sizeof (int));
+    state->frameNext = malloc(totalFrames * sizeof (int));
+    for (i = 0; i < totalFrames; i++) {
+        state->frameList[i] = LIST_NONE;
+    }
+    state->ghostPage = malloc(ghostSlots * sizeof (PageNumber));
+    state->ghostList = malloc(ghostSlots * sizeof (int));
+    state->ghostPrev = malloc(ghostSlots * sizeof (int));
+    state->ghostNext = malloc(ghostSlots * sizeof (int));
+    for (i = 0; i < ghostSlots; i++) {
+        state->ghostNext[i] = (i + 1 < ghostSlots) ? i + 1 : LIST_NONE;
+    }
+    state->freeGhost = 0;
+    state->ghostIndex = createHashTable(ghostSlots);
+    state->pendingGhost = LIST_NONE;
+    state->keepGhost = TRUE;
+    return state;
+}
+
+void freeAdaptiveState(struct adaptiveState *state) {
+    free(state->frameList);
+    free(state->framePrev);
+    free(state->frameNext);
+    free(state->ghostPage);
+    free(state->ghostList);
+    free(state->ghostPrev);
+    free(state->ghostNext);
+    freeHashTable(state->ghostIndex);
+    free(state);
+}
+
+static void adaptivePushFrame(struct adaptiveState *state, int list, int frame) {
+    state->frameList[frame] = list;
+    linkPushFront(&state->resident[list], state->framePrev, state->frameNext, frame);
+}
+
+static void adaptiveRemoveFrame(struct adaptiveState *state, int frame) {
+    linkRemove(&state->resident[state->frameList[frame]], state->framePrev, state->frameNext, frame);
+    state->frameList[frame] = LIST_NONE;
+}
+
+static void adaptiveDropGhost(struct adaptiveState *state, int slot) {
+    linkRemove(&state->ghost[state->ghostList[slot]], state->ghostPrev, state->ghostNext, slot);
+    hashRemove(state->ghostIndex, state->ghostPage[slot]);
+    state->ghostNext[slot] = state->freeGhost;
+    state->freeGhost = slot;
+}
+
+//forgets the oldest page number of a ghost list
+static void adaptiveDropOldestGhost(struct adaptiveState *state, int list) {
+    if (state->ghost[list].tail != LIST_NONE) {
+        adaptiveDropGhost(state, state->ghost[list].tail);
+    }
+}
+
+/**********************************************************************************
+ * Function Name: adaptiveAddGhost
+ *
+ * Description:
+ *      remembers the page number of an evicted page in a ghost list, dropping
+ *      the oldest ghost of that list once it holds limit entries
+ *
+ ***********************************************************************************/
+
+void adaptiveAddGhost(struct adaptiveState *state, int list, PageNumber pageNum, int limit) {
+    int slot;
+    if (pageNum == NO_PAGE || limit <= 0) {
+        return;
+    }
+    while (state->ghost[list].size >= limit) {
+        adaptiveDropOldestGhost(state, list);
+    }
+    if (state->freeGhost == LIST_NONE) { //both lists together are full, make room in the longer one
+        adaptiveDropOldestGhost(state, state->ghost[ADAPTIVE_RECENT].size >= state->ghost[ADAPTIVE_FREQUENT].size ? ADAPTIVE_RECENT : ADAPTIVE_FREQUENT);
+    }
+    slot = state->freeGhost;
+    state->freeGhost = state->ghostNext[slot];
+    state->ghostPage[slot] = pageNum;
+    state->ghostList[slot] = list;
+    linkPushFront(&state->ghost[list], state->ghostPrev, state->ghostNext, slot);
+    hashInsert(state->ghostIndex, pageNum, slot);
+}
+
+//takes an unpinned frame from the preferred list, or from the other list when all of its frames are pinned
+static int adaptiveTakeFrame(struct queuePool *queuePool, struct adaptiveState *state, int preferred, int *fromList) {
+    int frame = linkUnpinnedFromTail(queuePool, &state->resident[preferred], state->framePrev);
+    *fromList = preferred;
+    if (frame == LIST_NONE) {
+        *fromList = 1 - preferred;
+        frame = linkUnpinnedFromTail(queuePool, &state->resident[*fromList], state->framePrev);
+    }
+    if (frame != LIST_NONE) {
+        adaptiveRemoveFrame(state, frame);
+    }
+    return frame;
+}
+
+/**********************************************************************************
+ * Function Name: arcMiss
+ *
+ * Description:
+ *      will execute the adaptive replacement cache method. T1 holds pages seen
+ *      once recently, T2 pages seen at least twice. B1 and B2 remember the
+ *      page numbers last evicted from T1 and T2. A miss that hits B1 grows the
+ *      target size p of T1, a miss that hits B2 shrinks it, so the split
+ *      between recency and frequency tunes itself and a scan only churns T1.
+ *      arcMiss runs before the frame is chosen and keeps the ghost lists
+ *      within their bounds, arcVictim picks the frame.
+ *
+ ***********************************************************************************/
+
+void arcMiss(struct adaptiveState *arc, const PageNumber pageNum) {
+    struct linkList *t1 = &arc->resident[ADAPTIVE_RECENT];
+    struct linkList *b1 = &arc->ghost[ADAPTIVE_RECENT];
+    struct linkList *b2 = &arc->ghost[ADAPTIVE_FREQUENT];
+    int c = arc->capacity;
+    int ghostSlot = hashLookup(arc->ghostIndex, pageNum);
+
+    arc->pendingGhost = LIST_NONE;
+    arc->keepGhost = TRUE;
+    if (ghostSlot != HASH_EMPTY_SLOT) {
+        arc->pendingGhost = arc->ghostList[ghostSlot];
+        if (arc->pendingGhost == ADAPTIVE_RECENT) { //T1 was too small
+            int delta = (b2->size > b1->size) ? b2->size / b1->size : 1;
+            arc->target = (arc->target + delta < c) ? arc->target + delta : c;
+        } else { //T2 was too small
+            int delta = (b1->size > b2->size) ? b1->size / b2->size : 1;
+            arc->target = (arc->target - delta > 0) ? arc->target - delta : 0;
+        }
+        adaptiveDropGhost(arc, ghostSlot);
+    } else if (t1->size + b1->size >= c) { //the recency side holds c pages already
+        if (t1->size < c) {
+            adaptiveDropOldestGhost(arc, ADAPTIVE_RECENT);
+        } else {
+            arc->keepGhost = FALSE; //B1 is empty and T1 fills the pool, its LRU page is dropped for good
+        }
+    } else if (t1->size + arc->resident[ADAPTIVE_FREQUENT].size + b1->size + b2->size >= 2 * c) {
+        adaptiveDropOldestGhost(arc, ADAPTIVE_FREQUENT);
+    }
+}
+
+int arcVictim(struct queuePool *queuePool, struct adaptiveState *arc) {
+    struct linkList *t1 = &arc->resident[ADAPTIVE_RECENT];
+    int fromList;
+    int preferred = (t1->size > 0 && (t1->size > arc->target || (arc->pendingGhost == ADAPTIVE_FREQUENT && t1->size == arc->target)))
+            ? ADAPTIVE_RECENT : ADAPTIVE_FREQUENT;
+    int frame = adaptiveTakeFrame(queuePool, arc, preferred, &fromList);
+    if (frame != LIST_NONE && arc->keepGhost) {
+        adaptiveAddGhost(arc, fromList, queuePool->pageNumbers[frame], arc->capacity);
+    }
+    return frame;
+}
+
+void arcHit(struct adaptiveState *arc, int frame) { //any hit makes the page frequent
+    adaptiveRemoveFrame(arc, frame);
+    adaptivePushFrame(arc, ADAPTIVE_FREQUENT, frame);
+}
+
+/**********************************************************************************
+ * Function Name: twoQMiss
+ *
+ * Description:
+ *      will execute the 2Q page replacement method. New pages enter the FIFO
+ *      A1in and only move to the LRU list Am when they are requested again
+ *      after falling out into the ghost list A1out, so a scan passes through
+ *      A1in without touching Am. Pages evicted from Am keep a ghost as well.
+ *      Instead of a fixed Kin the size of A1in tunes itself like ARC's p: a
+ *      ghost hit in A1out grows it, a ghost hit among Am's ghosts shrinks it.
+ *
+ ***********************************************************************************/
+
+//Kout of the paper, 50% of the pool
+static inline int twoQGhostLimit(struct adaptiveState *twoQ) {
+    return (twoQ->capacity + 1) / 2;
+}
+
+void twoQMiss(struct adaptiveState *twoQ, const PageNumber pageNum) {
+    int ghostSlot = hashLookup(twoQ->ghostIndex, pageNum);
+    int ghostLimit = twoQGhostLimit(twoQ);
+
+    twoQ->pendingGhost = LIST_NONE;
+    if (ghostSlot != HASH_EMPTY_SLOT) {
+        twoQ->pendingGhost = twoQ->ghostList[ghostSlot];
+        if (twoQ->pendingGhost == ADAPTIVE_RECENT) {
+            twoQ->target = (twoQ->target < ghostLimit) ? twoQ->target + 1 : ghostLimit;
+        } else {
+            twoQ->target = (twoQ->target > 1) ? twoQ->target - 1 : 1;
+        }
+        adaptiveDropGhost(twoQ, ghostSlot);
+    }
+}
+
+int twoQVictim(struct queuePool *queuePool, struct adaptiveState *twoQ) {
+    int fromList;
+    int preferred = (twoQ->resident[ADAPTIVE_RECENT].size > twoQ->target || twoQ->resident[ADAPTIVE_FREQUENT].size == 0)
+            ? ADAPTIVE_RECENT : ADAPTIVE_FREQUENT;
+    int frame = adaptiveTakeFrame(queuePool, twoQ, preferred, &fromList);
+    if (frame != LIST_NONE) {
+        adaptiveAddGhost(twoQ, fromList, queuePool->pageNumbers[frame], twoQGhostLimit(twoQ));
+    }
+    return frame;
+}
+
+void twoQHit(struct adaptiveState *twoQ, int frame) {
+    if (twoQ->frameList[frame] == ADAPTIVE_FREQUENT) { //hits inside A1in are correlated references and ignored
+        adaptiveRemoveFrame(twoQ, frame);
+        adaptivePushFrame(twoQ, ADAPTIVE_FREQUENT, frame);
+    }
+}
+
+//pages found among the ghosts go straight to the frequent list, new pages to the recent one
+void adaptiveAdmit(struct adaptiveState *state, int frame) {
+    adaptivePushFrame(state, (state->pendingGhost != LIST_NONE) ? ADAPTIVE_FREQUENT : ADAPTIVE_RECENT, frame);
+    state->pendingGhost = LIST_NONE;
+}
+
+//a prefetched page joins the eviction end of the recent list. Prefetching is
+//no request for the page, so a ghost of it is dropped without tuning the target.
+void adaptiveAdmitPrefetched(struct adaptiveState *state, PageNumber pageNum, int frame) {
+    int ghostSlot = hashLookup(state->ghostIndex, pageNum);
+    if (ghostSlot != HASH_EMPTY_SLOT) {
+        adaptiveDropGhost(state, ghostSlot);
+    }
+    state->frameList[frame] = ADAPTIVE_RECENT;
+    linkPushBack(&state->resident[ADAPTIVE_RECENT], state->framePrev, state->frameNext, frame);
+}
+
+//a victim that stays in the pool goes back to the recent list, without the ghost its eviction left
+void adaptiveRestore(struct adaptiveState *state, PageNumber pageNum, int frame) {
+    int ghostSlot = hashLookup(state->ghostIndex, pageNum);
+    if (ghostSlot != HASH_EMPTY_SLOT) {
+        adaptiveDropGhost(state, ghostSlot);
+    }
+    adaptivePushFrame(state, ADAPTIVE_RECENT, frame);
+}
+
+//the first pin of a prefetched page counts as the page's first request
+void adaptiveFirstUse(struct adaptiveState *state, int frame) {
+    adaptiveRemoveFrame(state, frame);
+    adaptivePushFrame(state, ADAPTIVE_RECENT, frame);
+}
+
+/**********************************************************************************
+ * Function Name: createStrategyState
+ *
+ * Description:
+ *      allocates the replacement state of a strategy. Every strategy keeps
+ *      its state in arrays indexed by frame number.
+ *
+ ***********************************************************************************/
+
+void * createStrategyState(ReplacementStrategy strategy, int totalFrames, void *stratData) {
+    switch (strategy) {
+        case RS_FIFO:
+        case RS_LRU:
+            return createListState(totalFrames);
+        case RS_CLOCK:
+        case RS_CLOCK_LOCKFREE:
+            return createClockState(totalFrames);
+        case RS_LFU:
+            return createLFUState(totalFrames, stratData);
+        case RS_LRU_K:
+            return createLRUKState(totalFrames, stratData);
+        case RS_ARC:
+        case RS_2Q:
+            return createAdaptiveState(strategy, totalFrames);
+        default:
+            return NULL;
+    }
+}
+
+void freeStrategyState(ReplacementStrategy strategy, void *strategyData) {
+    switch (strategy) {
+        case RS_FIFO:
+        case RS_LRU:
+            freeListState(strategyData);
+            break;
+        case RS_CLOCK:
+        case RS_CLOCK_LOCKFREE:
+            freeClockState(strategyData);
+            break;
+        case RS_LFU:
+            freeLFUState(strategyData);
+            break;
+        case RS_LRU_K:
+            freeLRUKState(strategyData);
+            break;
+        case RS_ARC:
+        case RS_2Q:
+            freeAdaptiveState(strategyData);
+            break;
+        default:
+            break;
+    }
+}
+
+/**********************************************************************************
+ * Function Name: strategyHit
+ *
+ * Description:
+ *      tells the pool's strategy that a resident page was pinned again
+ *
+ ***********************************************************************************/
+
+void strategyHit(struct queuePool *queuePool, int frame) {
+    switch (queuePool->strategy) {
+        case RS_LRU:
+            listHit(queuePool->strategyData, frame);
+            break;
+        case RS_CLOCK:
+            clockHit(queuePool->strategyData, frame);
+            break;
+        case RS_CLOCK_LOCKFREE:
+            lockFreeClockMark(queuePool->strategyData, frame, 1);
+            break;
+        case RS_LFU:
+            lfuIncrement(queuePool->strategyData, frame);
+            break;
+        case RS_LRU_K:
+            lruKHit(queuePool->strategyData, frame);
+            break;
+        case RS_ARC:
+            arcHit(queuePool->strategyData, frame);
+            break;
+        case RS_2Q:
+            twoQHit(queuePool->strategyData, frame);
+            break;
+        default:
+            break;
+    }
+}
+
+/**********************************************************************************
+ * Function Name: strategyMiss
+ *
+ * Description:
+ *      tells the pool's strategy that pageNum is about to be loaded, before a
+ *      frame is chosen for it
+ *
+ ***********************************************************************************/
+
+void strategyMiss(struct queuePool *queuePool, const PageNumber pageNum) {
+    switch (queuePool->strategy) {
+        case RS_ARC:
+            arcMiss(queuePool->strategyData, pageNum);
+            break;
+        case RS_2Q:
+            twoQMiss(queuePool->strategyData, pageNum);
+            break;
+        default:
+            break;
+    }
+}
+
+/**********************************************************************************
+ * Function Name: strategyVictim
+ *
+ * Description:
+ *      asks the pool's strategy for an unpinned frame to reuse once every
+ *      frame is occupied. The frame is taken out of the strategy's state.
+ *
+ * Return:
+ *      the frame to reuse, LIST_NONE when every frame is pinned
+ *
+ ***********************************************************************************/
+
+int strategyVictim(struct queuePool *queuePool) {
+    switch (queuePool->strategy) {
+        case RS_FIFO:
+        case RS_LRU:
+            return listVictim(queuePool, queuePool->strategyData);
+        case RS_CLOCK:
+            return clockVictim(queuePool, queuePool->strategyData);
+        case RS_CLOCK_LOCKFREE:
+            return lockFreeClockVictim(queuePool, queuePool->strategyData);
+        case RS_LFU:
+            return lfuVictim(queuePool, queuePool->strategyData);
+        case RS_LRU_K:
+            return lruKVictim(queuePool, queuePool->strategyData);
+        case RS_ARC:
+            return arcVictim(queuePool, queuePool->strategyData);
+        case RS_2Q:
+            return twoQVictim(queuePool, queuePool->strategyData);
+        default:
+            return LIST_NONE;
+    }
+}
+
+/**********************************************************************************
+ * Function Name: strategyAdmit
+ *
+ * Description:
+ *      hands a frame back to the pool's strategy after a page was loaded
+ *      into it
+ *
+ ***********************************************************************************/
+
+void strategyAdmit(struct queuePool *queuePool, int frame) {
+    switch (queuePool->strategy) {
+        case RS_FIFO:
+        case RS_LRU:
+            listAdmit(queuePool->strategyData, frame);
+            break;
+        case RS_CLOCK:
+            clockHit(queuePool->strategyData, frame);
+            break;
+        case RS_CLOCK_LOCKFREE:
+            lockFreeClockMark(queuePool->strategyData, frame, 1);
+            break;
+        case RS_LFU:
+            lfuAdmit(queuePool->strategyData, frame);
+            break;
+        case RS_LRU_K:
+            lruKAdmit(queuePool->strategyData, queuePool->pageNumbers[frame], frame);
+            break;
+        case RS_ARC:
+        case RS_2Q:
+            adaptiveAdmit(queuePool->strategyData, frame);
+            break;
+        default:
+            break;
+    }
+}
+
+/**********************************************************************************
+ * Function Name: strategyRestore
+ *
+ * Description:
+ *      hands a victim back to the pool's strategy when it could not be
+ *      evicted after all: another thread pinned or dirtied it while it was
+ *      chosen, or writing it back failed. The frame still holds its page and
+ *      is treated as referenced just now.
+ *
+ ***********************************************************************************/
+
+void strategyRestore(struct queuePool *queuePool, int frame) {
+    switch (queuePool->strategy) {
+        case RS_ARC:
+        case RS_2Q:
+            adaptiveRestore(queuePool->strategyData, queuePool->pageNumbers[frame], frame);
+            break;
+        default:
+            strategyAdmit(queuePool, frame);
+            break;
+    }
+}
+
+/**********************************************************************************
+ * Function Name: strategyAdmitPrefetched
+ *
+ * Description:
+ *      hands a frame filled by read-ahead to the pool's strategy at low
+ *      priority: it is placed where it is evicted first, so pages nobody asks
+ *      for leave again without displacing the pages in use
+ *
+ ***********************************************************************************/
+
+void strategyAdmitPrefetched(struct queuePool *queuePool, int frame) {
+    switch (queuePool->strategy) {
+        case RS_FIFO:
+        case RS_LRU:
+        {
+            struct listState *list = queuePool->strategyData;
+            linkPushBack(&list->order, list->prev, list->next, frame);
+            break;
+        }
+        case RS_CLOCK:
+            ((struct clockState *) queuePool->strategyData)->refBit[frame] = 0; //no second chance
+            break;
+        case RS_CLOCK_LOCKFREE:
+            lockFreeClockMark(queuePool->strategyData, frame, 0);
+            break;
+        case RS_LFU:
+            lfuAdmitPrefetched(queuePool->strategyData, frame);
+            break;
+        case RS_LRU_K:
+            lruKAdmitPrefetched(queuePool->strategyData, queuePool->pageNumbers[frame], frame);
+            break;
+        case RS_ARC:
+        case RS_2Q:
+            adaptiveAdmitPrefetched(queuePool->strategyData, queuePool->pageNumbers[frame], frame);
+            break;
+        default:
+            break;
+    }
+}
+
+/**********************************************************************************
+ * Function Name: strategyFirstUse
+ *
+ * Description:
+ *      tells the pool's strategy that a prefetched page was pinned for the
+ *      first time. The page is treated as if it had been loaded just now.
+ *
+ ***********************************************************************************/
+
+void strategyFirstUse(struct queuePool *queuePool, int frame) {
+    switch (queuePool->strategy) {
+        case RS_FIFO:
+        case RS_LRU:
+            listHit(queuePool->strategyData, frame);
+            break;
+        case RS_CLOCK:
+            clockHit(queuePool->strategyData, frame);
+            break;
+        case RS_CLOCK_LOCKFREE:
+            lockFreeClockMark(queuePool->strategyData, frame, 1);
+            break;
+        case RS_LFU:
+            lfuRemoveFrame(queuePool->strategyData, frame);
+            lfuAdmit(queuePool->strategyData, frame);
+            break;
+        case RS_LRU_K:
+            lruKHit(queuePool->strategyData, frame);
+            break;
+        case RS_ARC:
+        case RS_2Q:
+            adaptiveFirstUse(queuePool->strategyData, frame);
+            break;
+        default:
+            break;
+    }
+}
+
+/**********************************************************************************
+ * Function Name: strategyEvictionOrder
+ *
+ * Description:
+ *      fills frames with up to max frames in the order the pool's strategy
+ *      would evict them, best effort: pin state is ignored and LRU-K lists its
+ *      heap level by level. The background writer cleans these frames first.
+ *
+ * Return:
+ *      number of frames filled in
+ *
+ ***********************************************************************************/
+
+static int linkCollectFromTail(struct linkList *list, int *prev, int *frames, int count, int max) {
+    int frame;
+    for (frame = list->tail; frame != LIST_NONE && count < max; frame = prev[frame]) {
+        frames[count++] = frame;
+    }
+    return count;
+}
+
+int strategyEvictionOrder(struct queuePool *queuePool, int *frames, int max) {
+    int count = 0, pass, i, b;
+    switch (queuePool->strategy) {
+        case RS_FIFO:
+        case RS_LRU:
+        {
+            struct listState *list = queuePool->strategyData;
+            return linkCollectFromTail(&list->order, list->prev, frames, 0, max);
+        }
+        case RS_CLOCK:
+        case RS_CLOCK_LOCKFREE:
+        {
+            struct clockState *clock = queuePool->strategyData;
+            int used = __atomic_load_n(&queuePool->occupiedFrames, __ATOMIC_RELAXED);
+            unsigned int hand = __atomic_load_n(&clock->hand, __ATOMIC_RELAXED);
+            for (pass = 0; pass < 2; pass++) { //frames without a second chance come first
+                for (i = 0; i < used && count < max; i++) {
+                    int frame = (hand + i) % queuePool->totalNumFrames;
+                    if (frame < used && frameInUse(queuePool, frame) && __atomic_load_n(&clock->refBit[frame], __ATOMIC_RELAXED) == pass) {
+                        frames[count++] = frame;
+                    }
+                }
+            }
+            return count;
+        }
+        case RS_LFU:
+        {
+            struct lfuState *lfu = queuePool->strategyData;
+            for (b = lfu->lowest; b != LIST_NONE && count < max; b = lfu->buckets[b].next) {
+                int frame;
+                for (frame = lfu->buckets[b].tail; frame != LIST_NONE && count < max; frame = lfu->framePrev[frame]) {
+                    frames[count++] = frame;
+                }
+            }
+            return count;
+        }
+        case RS_LRU_K:
+        {
+            struct lruKState *lruK = queuePool->strategyData;
+            for (i = 0; i < lruK->heapSize && count < max; i++) {
+                frames[count++] = lruK->heap[i];
+            }
+            return count;
+        }
+        case RS_ARC:
+        case RS_2Q:
+        {
+            struct adaptiveState *state = queuePool->strategyData;
+            int first = (state->resident[ADAPTIVE_RECENT].size > state->target) ? ADAPTIVE_RECENT : ADAPTIVE_FREQUENT;
+            count = linkCollectFromTail(&state->resident[first], state->framePrev, frames, 0, max);
+            return linkCollectFromTail(&state->resident[1 - first], state->framePrev, frames, count, max);
+        }
+        default:
+            return 0;
     }
-    return RC_OK;
 }
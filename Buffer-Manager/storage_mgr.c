@@ -1,62 +1,365 @@
+#define _GNU_SOURCE //O_DIRECT
 #include "dberror.h"
 #include "storage_mgr.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+//what an open SM_FileHandle keeps in mgmtInfo
+struct storageFile {
+    int fd; //all I/O is positional (pread/pwrite), there is no shared file cursor
+    int direct; //fd bypasses the kernel page cache (O_DIRECT), read with isDirect, cleared by dropDirect
+    pthread_mutex_t directLock; //one thread at a time switches the file to the page cache
+    char *map; //SM_IO_MMAP: shared mapping of the whole file, header included, NULL otherwise
+    size_t mapSize;
+    pthread_rwlock_t mapLock; //page copies hold it shared, growing the mapping holds it exclusive
+    struct uringRing *ring; //set up by the first batch write
+    int ringUnavailable;
+    pthread_mutex_t ringLock; //one batch uses the ring at a time, also guards setting up reader
+    struct asyncReader *reader; //set up by the first readBlockAsync
+    int readerUnavailable;
+    pthread_mutex_t growLock; //one resize at a time, a smaller one must not undo a larger one
+};
+
+//O_DIRECT transfers need buffer, offset and length aligned to the logical block
+//size of the device. 4 KB covers every device we use and divides every page size.
+#define DIRECT_IO_ALIGNMENT 4096
+
+static inline int isDirectAligned(const void *buffer) {
+    return ((uintptr_t) buffer & (DIRECT_IO_ALIGNMENT - 1)) == 0;
+}
+
+/**********************************************************************************
+ * The first page size bytes of every page file are its header. It starts with
+ * a pageFileHeader, the rest of the area is zero. Page p of the file follows
+ * at (p + 1) * pageSize.
+ ***********************************************************************************/
+
+#define PAGE_FILE_MAGIC "SMPF"
+#define PAGE_FILE_VERSION 1
+
+struct pageFileHeader {
+    char magic[4];
+    int version;
+    int pageSize;
+    int totalNumPages; //number of pages behind the header
+};
+
+//byte offset of a page, the header takes the first pageSize bytes
+static inline off_t pageOffset(SM_FileHandle *fHandle, int pageNum) {
+    return (off_t) (pageNum + 1) * fHandle->pageSize;
+}
+
+//page sizes are powers of two from 4 KB to 64 KB
+static inline int validPageSize(int pageSize) {
+    return pageSize >= MIN_PAGE_SIZE && pageSize <= MAX_PAGE_SIZE && (pageSize & (pageSize - 1)) == 0;
+}
+
+static inline int isDirect(struct storageFile *file) {
+    return __atomic_load_n(&file->direct, __ATOMIC_ACQUIRE);
+}
+
+//some filesystems accept O_DIRECT at open but fail the transfers with EINVAL,
+//from then on the file falls back to the page cache. wasDirect is isDirect from
+//before the failed transfer. TRUE when the transfer is worth retrying: the file
+//was direct and is buffered now, whichever thread switched it.
+static int dropDirect(struct storageFile *file, int wasDirect) {
+    if (!wasDirect) {
+        return 0;
+    }
+    pthread_mutex_lock(&file->directLock);
+    int flags = fcntl(file->fd, F_GETFL);
+    if (isDirect(file) && flags >= 0 && fcntl(file->fd, F_SETFL, flags & ~O_DIRECT) == 0) {
+        __atomic_store_n(&file->direct, 0, __ATOMIC_RELEASE); //only once the fd is buffered
+    }
+    int dropped = !isDirect(file);
+    pthread_mutex_unlock(&file->directLock);
+    return dropped;
+}
+
+#include "ioEngine.c" //the batch writes fall back to the page cache through dropDirect as well
+
+//reads size bytes at offset, retrying short reads. Bytes past the end of the file read as zero.
+static RC preadFully(struct storageFile *file, char *buffer, size_t size, off_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        int direct = isDirect(file);
+        ssize_t got = pread(file->fd, buffer + done, size - done, offset + done);
+        if (got < 0) {
+            if (errno == EINTR || (errno == EINVAL && dropDirect(file, direct))) {
+                continue;
+            }
+            return RC_READ_NON_EXISTING_PAGE;
+        }
+        if (got == 0) {
+            memset(buffer + done, 0, size - done);
+            break;
+        }
+        done += got;
+    }
+    return RC_OK;
+}
+
+static RC pwriteFully(struct storageFile *file, const char *buffer, size_t size, off_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        int direct = isDirect(file);
+        ssize_t put = pwrite(file->fd, buffer + done, size - done, offset + done);
+        if (put < 0) {
+            if (errno == EINTR || (errno == EINVAL && dropDirect(file, direct))) {
+                continue;
+            }
+            return RC_WRITE_FAILED;
+        }
+        done += put;
+    }
+    return RC_OK;
+}
+
+//page transfers go straight into the caller's buffer. Only a direct file given
+//an unaligned buffer goes through an aligned bounce buffer. A mapped file is
+//served by a copy from or into the mapping, no system call involved.
+static RC readPage(struct storageFile *file, char *memPage, size_t size, off_t offset) {
+    if (file->map != NULL) {
+        pthread_rwlock_rdlock(&file->mapLock);
+        memcpy(memPage, file->map + offset, size);
+        pthread_rwlock_unlock(&file->mapLock);
+        return RC_OK;
+    }
+    if (!isDirect(file) || isDirectAligned(memPage)) {
+        return preadFully(file, memPage, size, offset);
+    }
+    void *bounce;
+    if (posix_memalign(&bounce, DIRECT_IO_ALIGNMENT, size) != 0) {
+        return RC_READ_NON_EXISTING_PAGE;
+    }
+    RC rc = preadFully(file, bounce, size, offset);
+    if (rc == RC_OK) {
+        memcpy(memPage, bounce, size);
+    }
+    free(bounce);
+    return rc;
+}
+
+static RC writePage(struct storageFile *file, const char *memPage, size_t size, off_t offset) {
+    if (file->map != NULL) {
+        pthread_rwlock_rdlock(&file->mapLock); //writers to different pages may share the mapping
+        memcpy(file->map + offset, memPage, size);
+        pthread_rwlock_unlock(&file->mapLock);
+        return RC_OK;
+    }
+    if (!isDirect(file) || isDirectAligned(memPage)) {
+        return pwriteFully(file, memPage, size, offset);
+    }
+    void *bounce;
+    if (posix_memalign(&bounce, DIRECT_IO_ALIGNMENT, size) != 0) {
+        return RC_WRITE_FAILED;
+    }
+    memcpy(bounce, memPage, size);
+    RC rc = pwriteFully(file, bounce, size, offset);
+    free(bounce);
+    return rc;
+}
+
+//the header is written as a whole aligned block, which O_DIRECT accepts as well
+static RC writeHeader(struct storageFile *file, int pageSize, int totalNumPages) {
+    char block[DIRECT_IO_ALIGNMENT] __attribute__((aligned(DIRECT_IO_ALIGNMENT)));
+    struct pageFileHeader *header = (struct pageFileHeader *) block;
+    memset(block, 0, sizeof (block));
+    memcpy(header->magic, PAGE_FILE_MAGIC, sizeof (header->magic));
+    header->version = PAGE_FILE_VERSION;
+    header->pageSize = pageSize;
+    header->totalNumPages = totalNumPages;
+    return pwriteFully(file, block, sizeof (block), 0);
+}
 
 void initStorageManager(void) {
 }
 
 extern RC createPageFile(char *fileName) {
+    return createPageFileWithPageSize(fileName, PAGE_SIZE);
+}
 
-    FILE *filePtr;
+extern RC createPageFileWithPageSize(char *fileName, int pageSize) {
 
-    char initialSize[PAGE_SIZE] = {'\0'};
-    //filePtr = fopen(fileName, "wb");
-    filePtr = fopen(fileName, "w");
+    if (!validPageSize(pageSize)) {
+        return RC_INVALID_PAGE_SIZE;
+    }
 
-    if (filePtr == NULL) {
+    int fd = open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
         return RC_FILE_NOT_FOUND;
     }
 
-    fwrite(initialSize, sizeof (char), PAGE_SIZE, filePtr);
-    fclose(filePtr);
-    return RC_OK;
+    struct storageFile file = {.fd = fd};
+    RC rc = RC_OK;
+    if (ftruncate(fd, pageSize) != 0) { //a zeroed header area
+        rc = RC_WRITE_FAILED;
+    } else {
+        rc = writeHeader(&file, pageSize, 0);
+    }
+    close(fd);
+    return rc;
 }
 
 extern RC openPageFile(char *fileName, SM_FileHandle *fHandle) {
+    return openPageFileWithMode(fileName, fHandle, SM_IO_BUFFERED);
+}
+
+/**********************************************************************************
+ * SM_IO_DIRECT opens the file with O_DIRECT: pages move between the disk and the
+ * caller's buffer without a copy in the kernel page cache. Buffers should be
+ * aligned to 4 KB, unaligned ones cost an extra copy. When the filesystem
+ * rejects O_DIRECT (tmpfs for one) the file is opened buffered instead,
+ * getFileIOMode tells which mode is in effect.
+ *
+ * SM_IO_MMAP maps the file shared into memory. readBlock and writeBlock copy
+ * from and into the mapping, getBlockPointer hands out the address of a page in
+ * it. The mapping follows the file through mremap when the file grows.
+ ***********************************************************************************/
+
+static void freeStorageFile(struct storageFile *file) {
+    pthread_mutex_destroy(&file->directLock);
+    pthread_rwlock_destroy(&file->mapLock);
+    pthread_mutex_destroy(&file->ringLock);
+    pthread_mutex_destroy(&file->growLock);
+    free(file);
+}
 
-    FILE *filePtr;
-    //filePtr = fopen(fileName, "rb"); // Open file in read mode 
-    filePtr = fopen(fileName, "r+");
-    if (filePtr == NULL) { // If file pointer doesn't point to file , return error 
+extern RC openPageFileWithMode(char *fileName, SM_FileHandle *fHandle, SM_IOMode mode) {
+
+    char block[DIRECT_IO_ALIGNMENT] __attribute__((aligned(DIRECT_IO_ALIGNMENT)));
+    struct pageFileHeader *header = (struct pageFileHeader *) block;
+    struct storageFile *file = calloc(1, sizeof (struct storageFile));
+
+    file->fd = -1;
+    if (mode == SM_IO_DIRECT) {
+        file->fd = open(fileName, O_RDWR | O_DIRECT);
+        file->direct = (file->fd >= 0);
+    }
+    if (file->fd < 0) {
+        file->fd = open(fileName, O_RDWR);
+    }
+    if (file->fd < 0) { // If the file can't be opened , return error 
+        free(file);
         return RC_FILE_NOT_FOUND;
     }
+    pthread_mutex_init(&file->directLock, NULL); //the header read may already switch the file to the page cache
+    pthread_rwlock_init(&file->mapLock, NULL);
+    pthread_mutex_init(&file->ringLock, NULL);
+    pthread_mutex_init(&file->growLock, NULL);
+    RC rc = RC_OK;
+    if (preadFully(file, block, sizeof (block), 0) != RC_OK
+            || memcmp(header->magic, PAGE_FILE_MAGIC, sizeof (header->magic)) != 0
+            || header->version != PAGE_FILE_VERSION
+            || !validPageSize(header->pageSize)
+            || header->totalNumPages < 0) {
+        rc = RC_INVALID_FILE_HEADER;
+    } else if (mode == SM_IO_MMAP) {
+        file->mapSize = (size_t) (header->totalNumPages + 1) * header->pageSize;
+        file->map = mmap(NULL, file->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+        if (file->map == MAP_FAILED) {
+            file->map = NULL;
+            rc = RC_FILE_NOT_FOUND;
+        }
+    }
+    if (rc != RC_OK) {
+        close(file->fd);
+        freeStorageFile(file);
+        return rc;
+    }
 
-    fseek(filePtr, 0, SEEK_END); // makes the cursor position to end of the byte
-    int noOfBytes = ftell(filePtr); //no of bytes from beg(4096) because the pointer is at the end 
-
-    fHandle->totalNumPages = (int)ceil((double) noOfBytes / PAGE_SIZE); // total bytes from beg to end/page size
+    fHandle->mgmtInfo = file;
+    fHandle->totalNumPages = header->totalNumPages;
+    fHandle->pageSize = header->pageSize;
     fHandle->curPagePos = 0;
-    fHandle->mgmtInfo = filePtr;
     fHandle->fileName = fileName;
+    return RC_OK;
+}
+
+extern SM_IOMode getFileIOMode(SM_FileHandle *fHandle) {
+    struct storageFile *file = fHandle->mgmtInfo;
+    if (file != NULL && file->map != NULL) {
+        return SM_IO_MMAP;
+    }
+    return (file != NULL && isDirect(file)) ? SM_IO_DIRECT : SM_IO_BUFFERED;
+}
+
+//address of a page inside the mapping of an SM_IO_MMAP file. It stays valid
+//until the file grows, the mapping may move then.
+extern RC getBlockPointer(int pageNum, SM_FileHandle *fHandle, SM_PageHandle *memPage) {
 
-   // fclose(filePtr); //Close File 
+    struct storageFile *file = fHandle->mgmtInfo;
+    if (file == NULL || file->map == NULL) {
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    if (pageNum >= __atomic_load_n(&fHandle->totalNumPages, __ATOMIC_ACQUIRE) || pageNum < 0) {
+        return RC_READ_NON_EXISTING_PAGE;
+    }
+    *memPage = file->map + pageOffset(fHandle, pageNum);
     return RC_OK;
 }
 
-extern RC closePageFile(SM_FileHandle *fHandle) {
+//passes an access pattern hint for numPages pages from firstPage on to the
+//kernel, numPages 0 means up to the end of the file. Mapped files get madvise,
+//the others posix_fadvise.
+extern RC adviseFile(SM_FileHandle *fHandle, SM_AccessAdvice advice, int firstPage, int numPages) {
+
+    struct storageFile *file = fHandle->mgmtInfo;
+    static const int madviseFlags[] = {MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED};
+    static const int fadviseFlags[] = {POSIX_FADV_NORMAL, POSIX_FADV_SEQUENTIAL, POSIX_FADV_RANDOM, POSIX_FADV_WILLNEED};
+    int totalNumPages = __atomic_load_n(&fHandle->totalNumPages, __ATOMIC_ACQUIRE);
 
-   // FILE *filePtr = fopen(fHandle->fileName, "rb"); // Open file in read mode 
-    fclose(fHandle->mgmtInfo);
-   // if (filePtr == NULL) {
-    if (fHandle->mgmtInfo == NULL) {
+    if (file == NULL) {
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    if (advice < SM_ADVICE_NORMAL || advice > SM_ADVICE_WILLNEED || firstPage < 0 || numPages < 0) {
+        return RC_READ_NON_EXISTING_PAGE;
+    }
+    if (firstPage >= totalNumPages) {
+        return RC_OK;
+    }
+    if (numPages == 0 || firstPage + numPages > totalNumPages) {
+        numPages = totalNumPages - firstPage;
+    }
+
+    if (file->map != NULL) {
+        pthread_rwlock_rdlock(&file->mapLock);
+        int failed = madvise(file->map + pageOffset(fHandle, firstPage), (size_t) numPages * fHandle->pageSize, madviseFlags[advice]);
+        pthread_rwlock_unlock(&file->mapLock);
+        return failed ? RC_FILE_NOT_FOUND : RC_OK;
+    }
+    if (posix_fadvise(file->fd, pageOffset(fHandle, firstPage), (off_t) numPages * fHandle->pageSize, fadviseFlags[advice]) != 0) {
         return RC_FILE_NOT_FOUND;
     }
     return RC_OK;
 }
 
+extern RC closePageFile(SM_FileHandle *fHandle) {
+
+    struct storageFile *file = fHandle->mgmtInfo;
+    if (file == NULL) {
+        return RC_FILE_NOT_FOUND;
+    }
+    if (file->map != NULL) {
+        munmap(file->map, file->mapSize);
+    }
+    uringDestroy(file->ring);
+    asyncReaderDestroy(file->reader, file->fd);
+    int closed = close(file->fd);
+    freeStorageFile(file);
+    fHandle->mgmtInfo = NULL;
+    return (closed == 0) ? RC_OK : RC_FILE_NOT_FOUND;
+}
+
 extern RC destroyPageFile(char *fileName) {
     if (remove(fileName)) {
         return RC_FILE_NOT_FOUND;
@@ -65,39 +368,149 @@ extern RC destroyPageFile(char *fileName) {
 }
 
 
+/**********************************************************************************
+ * readBlock and writeBlock only use pread/pwrite at the page's own offset, so
+ * several threads may call them on one SM_FileHandle. The cursor they leave in
+ * curPagePos is set atomically, it only matters to the read*Block cursor calls.
+ ***********************************************************************************/
+
 extern RC readBlock(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage) {
 
+    int totalNumPages = __atomic_load_n(&fHandle->totalNumPages, __ATOMIC_ACQUIRE);
+
     //Checks if pageNum value is valid
-    if (pageNum > fHandle->totalNumPages || pageNum < 0 || fHandle->totalNumPages < 0) {
+    if (pageNum >= totalNumPages || pageNum < 0) {
         return RC_READ_NON_EXISTING_PAGE;
     }
 
-    FILE *filePtr = fHandle->mgmtInfo;
-    //filePtr = fopen(fHandle->fileName, "rb");
-
-    if (filePtr == NULL) { // If file pointer doesn't point to file , return error 
+    struct storageFile *file = fHandle->mgmtInfo;
+    if (file == NULL) { // If the handle isn't open , return error 
         return RC_FILE_NOT_FOUND;
     }
 
-    //int seekVal = fseek(filePtr, (pageNum * PAGE_SIZE), SEEK_SET); // Point the pointer to beg of the block
-    int seekVal = fseek(filePtr, ((pageNum + 1) * PAGE_SIZE), SEEK_SET);
-
-    printf("BYTES : %ld",ftell(filePtr));
+    if (readPage(file, memPage, fHandle->pageSize, pageOffset(fHandle, pageNum)) != RC_OK) { // read the file page into mempage array
+        return RC_READ_NON_EXISTING_PAGE;
+    }
+    __atomic_store_n(&fHandle->curPagePos, pageNum, __ATOMIC_RELAXED);
+    return RC_OK;
+}
 
-    printf("CURR POS : %d",(int)ceil((double) (ftell(filePtr)) / PAGE_SIZE));
-   
+//reads the buffers of iov from offset on, retrying short reads. Bytes past the end of the file read as zero.
+static RC preadvFully(struct storageFile *file, struct iovec *iov, int iovcnt, off_t offset) {
+    while (iovcnt > 0) {
+        int direct = isDirect(file);
+        ssize_t got = preadv(file->fd, iov, iovcnt, offset);
+        if (got < 0) {
+            if (errno == EINTR || (errno == EINVAL && dropDirect(file, direct))) {
+                continue;
+            }
+            return RC_READ_NON_EXISTING_PAGE;
+        }
+        if (got == 0) {
+            for (; iovcnt > 0; iov++, iovcnt--) {
+                memset(iov->iov_base, 0, iov->iov_len);
+            }
+            break;
+        }
+        offset += got;
+        iov = ioAdvance(iov, &iovcnt, got);
+    }
+    return RC_OK;
+}
 
-    if (seekVal != 0) {
+/**********************************************************************************
+ * Function Name: readBlocks
+ *
+ * Description:
+ *      reads the count consecutive pages starting at firstPage, page
+ *      firstPage + i into memPages[i]. The pages come in with one vectored
+ *      read, so a run costs one trip to the device instead of one per page.
+ *      Mapped files and direct files given unaligned buffers copy page by page.
+ *
+ * Return:
+ *      RC_OK when every page was read, RC_READ_NON_EXISTING_PAGE when a page
+ *      is outside the file or the read failed
+ *
+ ***********************************************************************************/
+
+extern RC readBlocks(int firstPage, int count, SM_FileHandle *fHandle, SM_PageHandle *memPages) {
+
+    int totalNumPages = __atomic_load_n(&fHandle->totalNumPages, __ATOMIC_ACQUIRE);
+    struct storageFile *file = fHandle->mgmtInfo;
+    int inPlace = 1;
+    int i;
+
+    if (file == NULL) {
+        return RC_FILE_NOT_FOUND;
+    }
+    if (firstPage < 0 || count < 0 || firstPage + count > totalNumPages) {
         return RC_READ_NON_EXISTING_PAGE;
     }
+    for (i = 0; i < count; i++) {
+        inPlace = inPlace && (!isDirect(file) || isDirectAligned(memPages[i]));
+    }
 
+    if (file->map != NULL || !inPlace || count > IOV_MAX) {
+        for (i = 0; i < count; i++) {
+            if (readPage(file, memPages[i], fHandle->pageSize, pageOffset(fHandle, firstPage + i)) != RC_OK) {
+                return RC_READ_NON_EXISTING_PAGE;
+            }
+        }
+        return RC_OK;
+    }
 
-    fread(memPage, sizeof (char), PAGE_SIZE, filePtr); // read the file page into mempage array
-    //fHandle->curPagePos = ceil((double) (ftell(filePtr) / PAGE_SIZE)) - 1; // get No of bytes from beg / Page size will point to current pos
-    fHandle->curPagePos = pageNum;
-    fHandle->mgmtInfo = filePtr;
+    struct iovec *iov = malloc(count * sizeof (struct iovec));
+    for (i = 0; i < count; i++) {
+        iov[i].iov_base = memPages[i];
+        iov[i].iov_len = fHandle->pageSize;
+    }
+    RC rc = preadvFully(file, iov, count, pageOffset(fHandle, firstPage));
+    free(iov);
+    return rc;
+}
 
-   // fclose(filePtr);
+/**********************************************************************************
+ * Function Name: readBlockAsync
+ *
+ * Description:
+ *      starts reading page pageNum into memPage and returns, done(context, rc)
+ *      is called once the page is in, from the file's completion thread. Many
+ *      reads may be in flight at once. Mapped files, direct files given an
+ *      unaligned buffer and systems without io_uring read the page before
+ *      returning and call done from the caller's thread.
+ *
+ * Return:
+ *      RC_OK when the read was started, done is called exactly once then.
+ *      RC_READ_NON_EXISTING_PAGE or RC_FILE_NOT_FOUND when it was not, done
+ *      is not called.
+ *
+ ***********************************************************************************/
+
+extern RC readBlockAsync(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage, SM_ReadCallback done, void *context) {
+
+    int totalNumPages = __atomic_load_n(&fHandle->totalNumPages, __ATOMIC_ACQUIRE);
+    struct storageFile *file = fHandle->mgmtInfo;
+
+    if (file == NULL) {
+        return RC_FILE_NOT_FOUND;
+    }
+    if (pageNum >= totalNumPages || pageNum < 0) {
+        return RC_READ_NON_EXISTING_PAGE;
+    }
+    if (file->map == NULL && (!isDirect(file) || isDirectAligned(memPage)) && batchEngine != SM_BATCH_THREADS) {
+        pthread_mutex_lock(&file->ringLock);
+        if (file->reader == NULL && !file->readerUnavailable) {
+            file->reader = asyncReaderCreate(file);
+            file->readerUnavailable = (file->reader == NULL);
+        }
+        struct asyncReader *reader = file->reader;
+        pthread_mutex_unlock(&file->ringLock);
+        if (reader != NULL && asyncRead(reader, file->fd, memPage, fHandle->pageSize, pageOffset(fHandle, pageNum), done, context)) {
+            __atomic_store_n(&fHandle->curPagePos, pageNum, __ATOMIC_RELAXED);
+            return RC_OK;
+        }
+    }
+    done(context, readBlock(pageNum, fHandle, memPage));
     return RC_OK;
 }
 
@@ -129,51 +542,150 @@ extern RC readNextBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
 
 extern RC readLastBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
 
-    if (fHandle->totalNumPages - 1 <= 0) {
+    if (fHandle->totalNumPages <= 0) {
         return RC_READ_NON_EXISTING_PAGE;
     }
-    return readBlock(fHandle->totalNumPages, fHandle, memPage);
-
-   // return readBlock(fHandle->totalNumPages - 1, fHandle, memPage);
+    return readBlock(fHandle->totalNumPages - 1, fHandle, memPage);
 }
 
 extern RC writeBlock(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage) {
 
+    int totalNumPages = __atomic_load_n(&fHandle->totalNumPages, __ATOMIC_ACQUIRE);
+    struct storageFile *file = fHandle->mgmtInfo;
 
-    FILE *filePtr = fHandle->mgmtInfo;
+    if (file == NULL) {
+        return RC_FILE_NOT_FOUND;
+    }
 
-   /*if(pageNum == 0 && fHandle->totalNumPages == 1){
-      filePtr = fopen(fHandle->fileName, "wb");
-    }else{
-      filePtr = fopen(fHandle->fileName, "ab");
-     }*/
+    if (pageNum >= totalNumPages || pageNum < 0) {
+        return RC_WRITE_FAILED;
+    }
+
+    if (writePage(file, memPage, fHandle->pageSize, pageOffset(fHandle, pageNum)) != RC_OK) { // pwrite has no user space buffer, the page reaches the OS right away
+        return RC_WRITE_FAILED;
+    }
+    __atomic_store_n(&fHandle->curPagePos, pageNum, __ATOMIC_RELAXED);
+    return RC_OK;
+}
 
-   
+struct batchPage {
+    int pageNum;
+    char *data;
+};
 
-    if (filePtr == NULL) {
+static int compareBatchPages(const void *a, const void *b) {
+    const struct batchPage *pa = a, *pb = b;
+    return (pa->pageNum > pb->pageNum) - (pa->pageNum < pb->pageNum);
+}
+
+/**********************************************************************************
+ * Function Name: writeBlocks
+ *
+ * Description:
+ *      writes count pages in one batch, page pageNums[i] from memPages[i], and
+ *      returns once all of them are written. The pages are written in page
+ *      number order, runs of consecutive pages as one vectored write of at
+ *      most maxWriteSize bytes (setMaxWriteSize). The writes go to io_uring
+ *      with many in flight, or to pwritev worker threads where io_uring is
+ *      unavailable (see ioEngine.c). Mapped files copy into the mapping.
+ *
+ * Return:
+ *      RC_OK when every page was written, RC_WRITE_FAILED otherwise
+ *
+ ***********************************************************************************/
+
+extern RC writeBlocks(int count, SM_FileHandle *fHandle, const int *pageNums, SM_PageHandle *memPages) {
+
+    int totalNumPages = __atomic_load_n(&fHandle->totalNumPages, __ATOMIC_ACQUIRE);
+    struct storageFile *file = fHandle->mgmtInfo;
+    int inPlace = 1;
+    int i;
+
+    if (file == NULL) {
         return RC_FILE_NOT_FOUND;
     }
-
-    if (fHandle->totalNumPages < pageNum || fHandle->totalNumPages < 0 || pageNum < 0) {
+    if (count < 0) {
         return RC_WRITE_FAILED;
     }
+    for (i = 0; i < count; i++) {
+        if (pageNums[i] >= totalNumPages || pageNums[i] < 0) {
+            return RC_WRITE_FAILED;
+        }
+        inPlace = inPlace && (!isDirect(file) || isDirectAligned(memPages[i]));
+    }
+    if (count == 0) {
+        return RC_OK;
+    }
+
+    if (file->map != NULL || !inPlace) { //copies, nothing to coalesce
+        for (i = 0; i < count; i++) {
+            if (writePage(file, memPages[i], fHandle->pageSize, pageOffset(fHandle, pageNums[i])) != RC_OK) {
+                return RC_WRITE_FAILED;
+            }
+        }
+        return RC_OK;
+    }
 
-    //int successvalue = fseek(filePtr, (PAGE_SIZE * pageNum), SEEK_SET);
+    struct batchPage *pages = malloc(count * sizeof (struct batchPage));
+    struct iovec *iov = malloc(count * sizeof (struct iovec));
+    struct ioRequest *requests = malloc(count * sizeof (struct ioRequest));
+    if (pages == NULL || iov == NULL || requests == NULL) {
+        free(requests);
+        free(iov);
+        free(pages);
+        return RC_WRITE_FAILED;
+    }
+    for (i = 0; i < count; i++) {
+        pages[i].pageNum = pageNums[i];
+        pages[i].data = memPages[i];
+    }
+    qsort(pages, count, sizeof (struct batchPage), compareBatchPages);
+
+    //cut the sorted pages into runs of consecutive page numbers
+    int runPages = maxWriteSize / fHandle->pageSize;
+    runPages = (runPages < 1) ? 1 : (runPages > IOV_MAX) ? IOV_MAX : runPages;
+    int runs = 0;
+    for (i = 0; i < count; i++) {
+        iov[i].iov_base = pages[i].data;
+        iov[i].iov_len = fHandle->pageSize;
+        if (i > 0 && pages[i].pageNum == pages[i - 1].pageNum + 1 && requests[runs - 1].iovcnt < runPages) {
+            requests[runs - 1].iovcnt++;
+            requests[runs - 1].size += fHandle->pageSize;
+            continue;
+        }
+        requests[runs].offset = pageOffset(fHandle, pages[i].pageNum);
+        requests[runs].iov = &iov[i];
+        requests[runs].iovcnt = 1;
+        requests[runs].size = fHandle->pageSize;
+        runs++;
+    }
 
-    int successvalue = fseek(filePtr, (PAGE_SIZE * (pageNum+1)), SEEK_SET);
-    if (successvalue != 0) {
-        return RC_FILE_NOT_FOUND;
+    RC rc = IO_ENGINE_UNAVAILABLE;
+    if (runs == 1) { //a single write, nothing to overlap
+        rc = ioWritevFully(file, requests[0].iov, requests[0].iovcnt, requests[0].offset);
+    } else if (batchEngine != SM_BATCH_THREADS) {
+        pthread_mutex_lock(&file->ringLock);
+        if (file->ring == NULL && !file->ringUnavailable) {
+            file->ring = uringCreate();
+            file->ringUnavailable = (file->ring == NULL);
+        }
+        if (file->ring != NULL) {
+            rc = uringWriteBatch(file->ring, file, requests, runs);
+            if (rc == IO_ENGINE_UNAVAILABLE) {
+                uringDestroy(file->ring);
+                file->ring = NULL;
+                file->ringUnavailable = 1;
+            }
+        }
+        pthread_mutex_unlock(&file->ringLock);
     }
-    fwrite(memPage, sizeof (char), PAGE_SIZE, filePtr);
-    fHandle->curPagePos = pageNum;
-    
-    //if(pageNum == fHandle->totalNumPages){
-      //fHandle->totalNumPages = fHandle->totalNumPages + 1;
-    //}
-    
-    fHandle->mgmtInfo = filePtr;
-    //fclose(filePtr);
-    return RC_OK;
+    if (rc == IO_ENGINE_UNAVAILABLE) {
+        rc = threadWriteBatch(file, requests, runs);
+    }
+    free(requests);
+    free(iov);
+    free(pages);
+    return rc;
 }
 
 extern RC writeCurrentBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
@@ -186,57 +698,66 @@ extern RC writeCurrentBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
         return RC_WRITE_FAILED;
 }
 
-extern RC appendEmptyBlock(SM_FileHandle *fHandle) {
+//grows the file to totalNumPages pages. The new pages are zero, ftruncate
+//allocates them without writing any data. The header is updated before the
+//new count is published to readers. Called with growLock held.
+static RC growFile(SM_FileHandle *fHandle, int totalNumPages) {
 
-    FILE *filePtr = fHandle->mgmtInfo;
+    struct storageFile *file = fHandle->mgmtInfo;
+    if (ftruncate(file->fd, pageOffset(fHandle, totalNumPages)) != 0) {
+        return RC_APPEND_ERROR;
+    }
+    if (writeHeader(file, fHandle->pageSize, totalNumPages) != RC_OK) {
+        return RC_APPEND_ERROR;
+    }
+    if (file->map != NULL) {
+        size_t mapSize = (size_t) pageOffset(fHandle, totalNumPages);
+        pthread_rwlock_wrlock(&file->mapLock); //the mapping may move, no copy may be running
+        char *map = mremap(file->map, file->mapSize, mapSize, MREMAP_MAYMOVE);
+        if (map != MAP_FAILED) {
+            file->map = map;
+            file->mapSize = mapSize;
+        }
+        pthread_rwlock_unlock(&file->mapLock);
+        if (map == MAP_FAILED) {
+            return RC_APPEND_ERROR;
+        }
+    }
+    __atomic_store_n(&fHandle->totalNumPages, totalNumPages, __ATOMIC_RELEASE); //readers only see the pages once they exist
+    return RC_OK;
+}
 
-   // filePtr = fopen(fHandle->fileName, "ab");
+extern RC appendEmptyBlock(SM_FileHandle *fHandle) {
 
-    if (filePtr == NULL) {
+    struct storageFile *file = fHandle->mgmtInfo;
+    if (file == NULL) {
         return RC_FILE_NOT_FOUND;
     }
-
-    fHandle->totalNumPages += 1;
-    fHandle->curPagePos = fHandle->totalNumPages - 1;
-    fseek(filePtr, (fHandle->totalNumPages) * PAGE_SIZE, SEEK_END); //SEEk_SET
-
-    char initialSize[PAGE_SIZE] = {'\0'};
-
-    fwrite(initialSize, sizeof (char), PAGE_SIZE, filePtr);
-    
-    rewind(filePtr);
-    fseek(filePtr, (fHandle->totalNumPages + 1) * PAGE_SIZE, SEEK_SET); //SEEk_SET
-
-    fHandle->mgmtInfo = filePtr;
-
-   // fclose(filePtr);
-    return RC_OK;
+    pthread_mutex_lock(&file->growLock);
+    int totalNumPages = fHandle->totalNumPages;
+    RC rc = growFile(fHandle, totalNumPages + 1);
+    if (rc == RC_OK) {
+        fHandle->curPagePos = totalNumPages;
+    }
+    pthread_mutex_unlock(&file->growLock);
+    return rc;
 }
 
 extern RC ensureCapacity(int numberOfPages, SM_FileHandle *fHandle) {
 
+    struct storageFile *file = fHandle->mgmtInfo;
+    RC rc = RC_OK;
 
-
-    int count = 0;
-
-    if (fHandle->totalNumPages >= numberOfPages) {
+    if (__atomic_load_n(&fHandle->totalNumPages, __ATOMIC_ACQUIRE) >= numberOfPages) {
         return RC_OK;
     }
-
-    int diff = numberOfPages - fHandle->totalNumPages;
-
-    for (int i = 0; i < diff; i++) {
-        if (appendEmptyBlock(fHandle) == RC_OK) {
-            continue;
-        } else {
-            count++;
-            break;
-        }
+    if (file == NULL) {
+        return RC_FILE_NOT_FOUND;
     }
-
-    if (count > 0) {
-        return RC_APPEND_ERROR;
+    pthread_mutex_lock(&file->growLock);
+    if (fHandle->totalNumPages < numberOfPages) { //another thread may have grown it meanwhile
+        rc = growFile(fHandle, numberOfPages); //one resize for all missing pages
     }
-    return RC_OK;
-
-}
\ No newline at end of file
+    pthread_mutex_unlock(&file->growLock);
+    return rc;
+}
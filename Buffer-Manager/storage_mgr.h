@@ -10,23 +10,53 @@ typedef struct SM_FileHandle {
   char *fileName;
   int totalNumPages;
   int curPagePos;
+  int pageSize; // read from the file header
   void *mgmtInfo;
 } SM_FileHandle;
 
 typedef char* SM_PageHandle;
 
+typedef enum SM_IOMode {
+  SM_IO_BUFFERED = 0, // through the kernel page cache
+  SM_IO_DIRECT = 1,   // O_DIRECT, falls back to buffered where unsupported
+  SM_IO_MMAP = 2      // pages are copied from and into a shared mapping of the file
+} SM_IOMode;
+
+typedef enum SM_AccessAdvice {
+  SM_ADVICE_NORMAL = 0,
+  SM_ADVICE_SEQUENTIAL = 1,
+  SM_ADVICE_RANDOM = 2,
+  SM_ADVICE_WILLNEED = 3
+} SM_AccessAdvice;
+
+// how writeBlocks issues a batch
+typedef enum SM_BatchEngine {
+  SM_BATCH_AUTO = 0,    // io_uring, pwrite worker threads where it is unavailable
+  SM_BATCH_THREADS = 1  // always the pwrite worker threads, and readBlockAsync reads synchronously
+} SM_BatchEngine;
+
+// called when a read of readBlockAsync finished, from the file's completion thread
+typedef void (*SM_ReadCallback) (void *context, RC rc);
+
 /************************************************************
  *                    interface                             *
  ************************************************************/
 /* manipulating page files */
 extern void initStorageManager (void);
 extern RC createPageFile (char *fileName);
+extern RC createPageFileWithPageSize (char *fileName, int pageSize);
 extern RC openPageFile (char *fileName, SM_FileHandle *fHandle);
+extern RC openPageFileWithMode (char *fileName, SM_FileHandle *fHandle, SM_IOMode mode);
+extern SM_IOMode getFileIOMode (SM_FileHandle *fHandle);
+extern RC adviseFile (SM_FileHandle *fHandle, SM_AccessAdvice advice, int firstPage, int numPages);
 extern RC closePageFile (SM_FileHandle *fHandle);
 extern RC destroyPageFile (char *fileName);
 
 /* reading blocks from disc */
 extern RC readBlock (int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage);
+extern RC readBlocks (int firstPage, int count, SM_FileHandle *fHandle, SM_PageHandle *memPages);
+extern RC readBlockAsync (int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage, SM_ReadCallback done, void *context);
+extern RC getBlockPointer (int pageNum, SM_FileHandle *fHandle, SM_PageHandle *memPage);
 extern int getBlockPos (SM_FileHandle *fHandle);
 extern RC readFirstBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern RC readPreviousBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
@@ -37,6 +67,9 @@ extern RC readLastBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
 /* writing blocks to a page file */
 extern RC writeBlock (int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern RC writeCurrentBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
+extern RC writeBlocks (int count, SM_FileHandle *fHandle, const int *pageNums, SM_PageHandle *memPages);
+extern void setBatchWriteEngine (SM_BatchEngine engine);
+extern void setMaxWriteSize (int bytes);
 extern RC appendEmptyBlock (SM_FileHandle *fHandle);
 extern RC ensureCapacity (int numberOfPages, SM_FileHandle *fHandle);
 
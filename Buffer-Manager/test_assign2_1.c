@@ -7,6 +7,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
 
 // var to store the current test's name
 char *testName;
@@ -37,12 +40,33 @@ static void testReadPage (void);
 
 static void testFIFO (void);
 static void testLRU (void);
+static void testCLOCK (void);
+static void testLFU (void);
+static void testLRU_K (void);
+static void testARC (void);
+static void test2Q (void);
+static void testPageSize (void);
+static void testDirectIO (void);
+static void testMmapIO (void);
+static void testBatchFlush (void);
+static void testBackgroundWriter (void);
+static void testReadAhead (void);
+static void testConcurrentPins (void);
+static void testShardedPool (void);
+static void testPageLatches (void);
+static void testOptimisticReads (void);
+static void testFrameBudget (void);
+static void testBatchPins (void);
+static void testAccessStrategies (void);
+static void testAsyncPins (void);
+static void testMergedReads (void);
+static void testDirtyDuringFlush (void);
 
 // main method
 int 
 main (void) 
 {
-printf("devika");exit(0);
+
 
   initStorageManager();
   testName = "";
@@ -51,6 +75,27 @@ printf("devika");exit(0);
   testReadPage();
   testFIFO();
   testLRU();
+  testCLOCK();
+  testLFU();
+  testLRU_K();
+  testARC();
+  test2Q();
+  testPageSize();
+  testDirectIO();
+  testMmapIO();
+  testBatchFlush();
+  testBackgroundWriter();
+  testReadAhead();
+  testConcurrentPins();
+  testShardedPool();
+  testPageLatches();
+  testOptimisticReads();
+  testFrameBudget();
+  testBatchPins();
+  testAccessStrategies();
+  testAsyncPins();
+  testMergedReads();
+  testDirtyDuringFlush();
 }
 
 // create n pages with content "Page X" and read them back to check whether the content is right
@@ -89,7 +134,7 @@ createDummyPages(BM_BufferPool *bm, int num)
       sprintf(h->data, "%s-%i", "Page", h->pageNum);
       CHECK(markDirty(bm, h));
       CHECK(unpinPage(bm,h));
-if(i == 3){exit(0);}
+
 
     }
 
@@ -301,3 +346,1565 @@ testLRU (void)
   free(h);
   TEST_DONE();
 }
+
+// test the CLOCK page replacement strategy
+void
+testCLOCK (void)
+{
+  // expected results
+  const char *poolContents[] = {
+    // fill the pool, every page gets its reference bit set
+    "[3 0],[-1 0],[-1 0],[-1 0]",
+    "[3 0],[2 0],[-1 0],[-1 0]",
+    "[3 0],[2 0],[0 0],[-1 0]",
+    "[3 0],[2 0],[0 0],[8 0]",
+    // first full turn clears all bits and takes frame 0
+    "[4 0],[2 0],[0 0],[8 0]",
+    "[4 0],[2 0],[0 0],[8 0]",
+    // page 2 was referenced again so it survives the next sweep
+    "[4 0],[2 0],[5 0],[8 0]",
+    "[4 0],[2 0],[5 0],[0 0]",
+    "[4 0],[9 0],[5 0],[0 0]",
+    "[8 0],[9 0],[5 0],[0 0]",
+    "[8 0],[9 0],[3 0],[0 0]",
+    "[8 0],[9 0],[3 0],[2 0]"
+  };
+  const int requests[] = {3,2,0,8,4,2,5,0,9,8,3,2};
+  const int numRequests = 12;
+
+  // the lock free variant evicts the same pages when pinned from one thread
+  ReplacementStrategy strategies[] = { RS_CLOCK, RS_CLOCK_LOCKFREE };
+  int i, s;
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  testName = "Testing CLOCK page replacement";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  createDummyPages(bm, 100);
+  for (s = 0; s < 2; s++)
+  {
+      CHECK(initBufferPool(bm, "testbuffer.bin", 4, strategies[s], NULL));
+
+      for(i = 0; i < numRequests; i++)
+      {
+          pinPage(bm, h, requests[i]);
+          unpinPage(bm, h);
+          ASSERT_EQUALS_POOL(poolContents[i], bm, "check pool content using pages");
+      }
+
+      // a pinned frame is skipped by the hand
+      CHECK(pinPage(bm, h, 8));
+      CHECK(pinPage(bm, h, 10));
+      ASSERT_EQUALS_POOL("[8 1],[10 1],[3 0],[2 0]", bm, "pinned page is not evicted");
+      h->pageNum = 8;
+      CHECK(unpinPage(bm, h));
+      h->pageNum = 10;
+      CHECK(unpinPage(bm, h));
+
+      ASSERT_EQUALS_INT(0, getNumWriteIO(bm), "check number of write I/Os");
+      ASSERT_EQUALS_INT(12, getNumReadIO(bm), "check number of read I/Os");
+
+      CHECK(shutdownBufferPool(bm));
+  }
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// test the LFU page replacement strategy with and without aging
+void
+testLFU (void)
+{
+  // expected results
+  const char *poolContents[] = {
+    "[0 0],[1 0],[2 0]",
+    // page 2 has the lowest count
+    "[0 0],[1 0],[3 0]",
+    "[0 0],[1 0],[4 0]",
+    "[0 0],[1 0],[2 0]",
+    // page 2 is now used more than page 1
+    "[0 0],[5 0],[2 0]"
+  };
+  const char *agingContents[] = {
+    // the scan pushes the inflation up until page 0 is no longer ahead
+    "[0 0],[3 0],[2 0]",
+    "[0 0],[3 0],[4 0]",
+    "[0 0],[5 0],[4 0]",
+    "[0 0],[5 0],[6 0]",
+    "[0 0],[7 0],[6 0]",
+    "[0 0],[7 0],[8 0]",
+    "[9 0],[7 0],[8 0]"
+  };
+  const int useRequests[] = {0,0,1};
+  const int missRequests[] = {3,4,2};
+  BM_LFUParams params;
+
+  int i;
+  int snapshot = 0;
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  testName = "Testing LFU page replacement";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  createDummyPages(bm, 100);
+  CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_LFU, NULL));
+
+  // read the first three pages and use pages 0 and 1 again
+  for(i = 0; i < 3; i++)
+  {
+      pinPage(bm, h, i);
+      unpinPage(bm, h);
+  }
+  for(i = 0; i < 3; i++)
+  {
+      pinPage(bm, h, useRequests[i]);
+      unpinPage(bm, h);
+  }
+  ASSERT_EQUALS_POOL(poolContents[snapshot++], bm, "check pool content reading in pages");
+
+  // misses always replace the page with the lowest count
+  for(i = 0; i < 3; i++)
+  {
+      pinPage(bm, h, missRequests[i]);
+      unpinPage(bm, h);
+      ASSERT_EQUALS_POOL(poolContents[snapshot++], bm, "check pool content using pages");
+  }
+
+  // use page 2 until it overtakes page 1
+  for(i = 0; i < 3; i++)
+  {
+      pinPage(bm, h, 2);
+      unpinPage(bm, h);
+  }
+  pinPage(bm, h, 5);
+  unpinPage(bm, h);
+  ASSERT_EQUALS_POOL(poolContents[snapshot++], bm, "check pool content using pages");
+
+  ASSERT_EQUALS_INT(7, getNumReadIO(bm), "check number of read I/Os");
+  CHECK(shutdownBufferPool(bm));
+
+  // with aging a page that was hot before a scan eventually decays out
+  params.aging = TRUE;
+  CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_LFU, &params));
+  for(i = 0; i < 3; i++)
+  {
+      pinPage(bm, h, i);
+      unpinPage(bm, h);
+  }
+  for(i = 0; i < 3; i++)
+  {
+      pinPage(bm, h, 0);
+      unpinPage(bm, h);
+  }
+  for(i = 3; i < 10; i++)
+  {
+      pinPage(bm, h, i);
+      unpinPage(bm, h);
+      ASSERT_EQUALS_POOL(agingContents[i - 3], bm, "check pool content during scan");
+  }
+
+  CHECK(shutdownBufferPool(bm));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// test the LRU-K page replacement strategy with K = 2
+void
+testLRU_K (void)
+{
+  // expected results
+  const char *poolContents[] = {
+    // pages seen only once are evicted before pages 0 and 1
+    "[0 0],[1 0],[3 0]",
+    "[0 0],[1 0],[4 0]",
+    // page 2 comes back with its retained history, now it has two references
+    "[0 0],[1 0],[2 0]",
+    // page 0 has the oldest second to last reference
+    "[5 0],[1 0],[2 0]",
+    "[6 0],[1 0],[2 0]"
+  };
+  const int requests[] = {3,4,2,5,6};
+  int k = 2;
+
+  int i;
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  testName = "Testing LRU-K page replacement";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  createDummyPages(bm, 100);
+  CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_LRU_K, &k));
+
+  // read the first three pages and reference pages 0 and 1 a second time
+  for(i = 0; i < 3; i++)
+  {
+      pinPage(bm, h, i);
+      unpinPage(bm, h);
+  }
+  for(i = 0; i < 2; i++)
+  {
+      pinPage(bm, h, i);
+      unpinPage(bm, h);
+  }
+  ASSERT_EQUALS_POOL("[0 0],[1 0],[2 0]", bm, "check pool content reading in pages");
+
+  for(i = 0; i < 5; i++)
+  {
+      pinPage(bm, h, requests[i]);
+      unpinPage(bm, h);
+      ASSERT_EQUALS_POOL(poolContents[i], bm, "check pool content using pages");
+  }
+
+  // page 7 is on top of the heap but pinned, so page 1 goes instead
+  CHECK(pinPage(bm, h, 7));
+  CHECK(pinPage(bm, h, 8));
+  ASSERT_EQUALS_POOL("[7 1],[8 1],[2 0]", bm, "pinned page is not evicted");
+  CHECK(unpinPage(bm, h));
+  h->pageNum = 7;
+  CHECK(unpinPage(bm, h));
+
+  ASSERT_EQUALS_INT(0, getNumWriteIO(bm), "check number of write I/Os");
+  ASSERT_EQUALS_INT(10, getNumReadIO(bm), "check number of read I/Os");
+
+  CHECK(shutdownBufferPool(bm));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// test that ARC keeps frequently used pages through a scan
+void
+testARC (void)
+{
+  // expected results
+  const char *poolContents[] = {
+    // pages 0 and 1 are used twice and live in T2, the scan only churns T1
+    "[0 0],[1 0],[10 0],[-1 0]",
+    "[0 0],[1 0],[10 0],[11 0]",
+    "[0 0],[1 0],[12 0],[11 0]",
+    "[0 0],[1 0],[12 0],[13 0]",
+    "[0 0],[1 0],[14 0],[13 0]",
+    "[0 0],[1 0],[14 0],[15 0]",
+    "[0 0],[1 0],[16 0],[15 0]",
+    "[0 0],[1 0],[16 0],[17 0]"
+  };
+
+  int i;
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  testName = "Testing ARC page replacement";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  createDummyPages(bm, 100);
+  CHECK(initBufferPool(bm, "testbuffer.bin", 4, RS_ARC, NULL));
+
+  for(i = 0; i < 4; i++)
+  {
+      pinPage(bm, h, i % 2);
+      unpinPage(bm, h);
+  }
+  for(i = 0; i < 8; i++)
+  {
+      pinPage(bm, h, 10 + i);
+      unpinPage(bm, h);
+      ASSERT_EQUALS_POOL(poolContents[i], bm, "check pool content during scan");
+  }
+
+  // page 13 was evicted from T1 and is remembered in B1, it returns into T2
+  pinPage(bm, h, 13);
+  unpinPage(bm, h);
+  ASSERT_EQUALS_POOL("[0 0],[1 0],[13 0],[17 0]", bm, "check pool content after ghost hit");
+  pinPage(bm, h, 0);
+  unpinPage(bm, h);
+  pinPage(bm, h, 1);
+  unpinPage(bm, h);
+
+  ASSERT_EQUALS_INT(0, getNumWriteIO(bm), "check number of write I/Os");
+  ASSERT_EQUALS_INT(11, getNumReadIO(bm), "check number of read I/Os");
+
+  CHECK(shutdownBufferPool(bm));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// test that 2Q promotes pages through its ghost list and keeps them through a scan
+void
+test2Q (void)
+{
+  // expected results
+  const char *poolContents[] = {
+    // pages 0 and 1 fall out of A1in and come back into Am
+    "[4 0],[1 0],[2 0],[3 0]",
+    "[4 0],[0 0],[2 0],[3 0]",
+    "[4 0],[0 0],[1 0],[3 0]",
+    // A1in has grown to its target, so the first scan page costs Am a page
+    "[4 0],[10 0],[1 0],[3 0]",
+    "[4 0],[10 0],[1 0],[11 0]",
+    "[12 0],[10 0],[1 0],[11 0]",
+    "[12 0],[13 0],[1 0],[11 0]",
+    "[12 0],[13 0],[1 0],[14 0]",
+    "[15 0],[13 0],[1 0],[14 0]",
+    // page 0 comes back from the ghosts of Am
+    "[15 0],[0 0],[1 0],[14 0]"
+  };
+  const int requests[] = {4,0,1,10,11,12,13,14,15,0};
+
+  int i;
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  testName = "Testing 2Q page replacement";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  createDummyPages(bm, 100);
+  CHECK(initBufferPool(bm, "testbuffer.bin", 4, RS_2Q, NULL));
+
+  for(i = 0; i < 4; i++)
+  {
+      pinPage(bm, h, i);
+      unpinPage(bm, h);
+  }
+  for(i = 0; i < 10; i++)
+  {
+      pinPage(bm, h, requests[i]);
+      unpinPage(bm, h);
+      ASSERT_EQUALS_POOL(poolContents[i], bm, "check pool content using pages");
+  }
+
+  ASSERT_EQUALS_INT(0, getNumWriteIO(bm), "check number of write I/Os");
+  ASSERT_EQUALS_INT(14, getNumReadIO(bm), "check number of read I/Os");
+
+  CHECK(shutdownBufferPool(bm));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// a page file with 16 KB pages: the pool takes the page size from the file
+// header and the last byte of every page survives a round trip
+void
+testPageSize ()
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  SM_FileHandle fh;
+  int i;
+
+  testName = "Page size from the page file header";
+
+  ASSERT_ERROR(createPageFileWithPageSize("testbuffer.bin", 3000), "page size must be a power of two");
+  CHECK(createPageFileWithPageSize("testbuffer.bin", 16384));
+  CHECK(initBufferPool(bm, "testbuffer.bin", 2, RS_LRU, NULL));
+  ASSERT_EQUALS_INT(16384, getPageSize(bm), "frames are sized from the header");
+
+  for (i = 0; i < 5; i++)
+  {
+      CHECK(pinPage(bm, h, i));
+      sprintf(h->data, "Page-%i", i);
+      h->data[16383] = 'a' + i;
+      CHECK(markDirty(bm, h));
+      CHECK(unpinPage(bm, h));
+  }
+  CHECK(shutdownBufferPool(bm));
+
+  CHECK(openPageFile("testbuffer.bin", &fh));
+  ASSERT_EQUALS_INT(16384, fh.pageSize, "page size read from the header");
+  ASSERT_EQUALS_INT(5, fh.totalNumPages, "page count read from the header");
+  CHECK(closePageFile(&fh));
+
+  CHECK(initBufferPool(bm, "testbuffer.bin", 2, RS_LRU, NULL));
+  for (i = 0; i < 5; i++)
+  {
+      char expected[16];
+      CHECK(pinPage(bm, h, i));
+      sprintf(expected, "Page-%i", i);
+      ASSERT_EQUALS_STRING(expected, h->data, "reading back page content");
+      ASSERT_TRUE(h->data[16383] == 'a' + i, "last byte of the page");
+      CHECK(unpinPage(bm, h));
+  }
+  CHECK(shutdownBufferPool(bm));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// write pages through a pool in direct I/O mode and read them back through
+// a buffered one
+void
+testDirectIO ()
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  SM_FileHandle fh;
+  char expected[16];
+  int i;
+
+  testName = "Direct I/O mode";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  CHECK(openPageFileWithMode("testbuffer.bin", &fh, SM_IO_DIRECT));
+  ASSERT_TRUE(getFileIOMode(&fh) == SM_IO_DIRECT || getFileIOMode(&fh) == SM_IO_BUFFERED, "direct or fallback");
+  CHECK(closePageFile(&fh));
+
+  CHECK(initBufferPoolWithMode(bm, "testbuffer.bin", 3, RS_FIFO, NULL, SM_IO_DIRECT));
+  for (i = 0; i < 10; i++)
+  {
+      CHECK(pinPage(bm, h, i));
+      sprintf(h->data, "Page-%i", i);
+      CHECK(markDirty(bm, h));
+      CHECK(unpinPage(bm, h));
+  }
+  CHECK(shutdownBufferPool(bm));
+
+  CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+  for (i = 0; i < 10; i++)
+  {
+      CHECK(pinPage(bm, h, i));
+      sprintf(expected, "Page-%i", i);
+      ASSERT_EQUALS_STRING(expected, h->data, "reading back page content");
+      CHECK(unpinPage(bm, h));
+  }
+  CHECK(shutdownBufferPool(bm));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// a pool on a mapped page file: the file grows while pages are written, the
+// content reads back buffered and through a pointer into the mapping
+void
+testMmapIO ()
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  SM_FileHandle fh;
+  SM_PageHandle mapped;
+  char expected[16];
+  int i;
+
+  testName = "Memory mapped I/O mode";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  CHECK(initBufferPoolWithMode(bm, "testbuffer.bin", 3, RS_LRU, NULL, SM_IO_MMAP));
+  CHECK(adviseBufferPool(bm, SM_ADVICE_SEQUENTIAL, 0, 0));
+  for (i = 0; i < 10; i++)
+  {
+      CHECK(pinPage(bm, h, i));
+      sprintf(h->data, "Page-%i", i);
+      CHECK(markDirty(bm, h));
+      CHECK(unpinPage(bm, h));
+  }
+  CHECK(shutdownBufferPool(bm));
+
+  CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_LRU, NULL));
+  for (i = 0; i < 10; i++)
+  {
+      CHECK(pinPage(bm, h, i));
+      sprintf(expected, "Page-%i", i);
+      ASSERT_EQUALS_STRING(expected, h->data, "reading back page content");
+      CHECK(unpinPage(bm, h));
+  }
+  CHECK(shutdownBufferPool(bm));
+
+  CHECK(openPageFileWithMode("testbuffer.bin", &fh, SM_IO_MMAP));
+  ASSERT_TRUE(getFileIOMode(&fh) == SM_IO_MMAP, "file is mapped");
+  CHECK(adviseFile(&fh, SM_ADVICE_WILLNEED, 2, 3));
+  CHECK(getBlockPointer(7, &fh, &mapped));
+  ASSERT_EQUALS_STRING("Page-7", mapped, "page read in place from the mapping");
+  ASSERT_ERROR(getBlockPointer(10, &fh, &mapped), "no pointer past the last page");
+  CHECK(closePageFile(&fh));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// forceFlushPool writes every dirty frame in one batch, through io_uring (or
+// its fallback) and through the pwritev workers, with and without a small
+// cap on the size of one coalesced write
+void
+testBatchFlush ()
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  SM_BatchEngine engines[] = { SM_BATCH_AUTO, SM_BATCH_THREADS, SM_BATCH_AUTO };
+  int maxWrites[] = { 0, 0, 3 * PAGE_SIZE };
+  char expected[16];
+  int e, i;
+
+  testName = "Batched flush of dirty pages";
+
+  for (e = 0; e < 3; e++)
+  {
+      setBatchWriteEngine(engines[e]);
+      setMaxWriteSize(maxWrites[e]);
+      CHECK(createPageFile("testbuffer.bin"));
+      CHECK(initBufferPool(bm, "testbuffer.bin", 200, RS_CLOCK, NULL));
+      for (i = 0; i < 200; i++)
+      {
+	  CHECK(pinPage(bm, h, (i * 7) % 200)); //dirty pages reach the flush out of order
+	  sprintf(h->data, "Page-%i-%i", h->pageNum, e);
+	  CHECK(markDirty(bm, h));
+	  CHECK(unpinPage(bm, h));
+      }
+      CHECK(forceFlushPool(bm));
+      ASSERT_EQUALS_INT(200, getNumWriteIO(bm), "one write per dirty page");
+      for (i = 0; i < 200; i++)
+	ASSERT_TRUE(!getDirtyFlags(bm)[i], "dirty flags cleared once the batch completed");
+      CHECK(shutdownBufferPool(bm));
+
+      CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+      for (i = 0; i < 200; i++)
+      {
+	  CHECK(pinPage(bm, h, i));
+	  sprintf(expected, "Page-%i-%i", i, e);
+	  ASSERT_EQUALS_STRING(expected, h->data, "reading back flushed page");
+	  CHECK(unpinPage(bm, h));
+      }
+      CHECK(shutdownBufferPool(bm));
+      CHECK(destroyPageFile("testbuffer.bin"));
+  }
+  setBatchWriteEngine(SM_BATCH_AUTO);
+  setMaxWriteSize(0);
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// the background writer cleans the dirty frames of the pool, after that
+// evicting them needs no write
+void
+testBackgroundWriter ()
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  BM_WriterParams params = { 10, 50, 64 };
+  struct timespec pause = { 0, 10000000 };
+  char expected[16];
+  int i, waited, writes;
+
+  testName = "Background writer";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  CHECK(initBufferPool(bm, "testbuffer.bin", 10, RS_LRU, NULL));
+  CHECK(startBackgroundWriter(bm, &params));
+  for (i = 0; i < 10; i++)
+  {
+      CHECK(pinPage(bm, h, i));
+      sprintf(h->data, "Page-%i", i);
+      CHECK(markDirty(bm, h));
+      CHECK(unpinPage(bm, h));
+  }
+
+  for (waited = 0; getNumBackgroundWriteIO(bm) < 10 && waited < 200; waited++)
+    nanosleep(&pause, NULL);
+  CHECK(stopBackgroundWriter(bm));
+  ASSERT_EQUALS_INT(10, getNumBackgroundWriteIO(bm), "pages written in the background");
+  for (i = 0; i < 10; i++)
+    ASSERT_TRUE(!getDirtyFlags(bm)[i], "writer cleaned every frame");
+
+  writes = getNumWriteIO(bm);
+  for (i = 10; i < 20; i++)
+  {
+      CHECK(pinPage(bm, h, i));
+      CHECK(unpinPage(bm, h));
+  }
+  ASSERT_EQUALS_INT(writes, getNumWriteIO(bm), "evicting clean victims writes nothing");
+  CHECK(shutdownBufferPool(bm));
+
+  CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+  for (i = 0; i < 10; i++)
+  {
+      CHECK(pinPage(bm, h, i));
+      sprintf(expected, "Page-%i", i);
+      ASSERT_EQUALS_STRING(expected, h->data, "reading back page written in the background");
+      CHECK(unpinPage(bm, h));
+  }
+  CHECK(shutdownBufferPool(bm));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// a sequential scan is served by read-ahead after its first pages, with every
+// strategy. Pages read ahead wait at the eviction end until they are pinned.
+void
+testReadAhead ()
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  ReplacementStrategy strategies[] = { RS_FIFO, RS_LRU, RS_CLOCK, RS_LFU, RS_LRU_K, RS_ARC, RS_2Q, RS_CLOCK_LOCKFREE };
+  int hot[] = { 10, 20, 30, 40, 50, 60 };
+  char expected[16];
+  int s, i, reads;
+
+  testName = "Sequential read-ahead";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  CHECK(initBufferPool(bm, "testbuffer.bin", 10, RS_FIFO, NULL));
+  for (i = 0; i < 100; i++)
+  {
+      CHECK(pinPage(bm, h, i));
+      sprintf(h->data, "Page-%i", i);
+      CHECK(markDirty(bm, h));
+      CHECK(unpinPage(bm, h));
+  }
+  CHECK(shutdownBufferPool(bm));
+
+  for (s = 0; s < 8; s++)
+  {
+      CHECK(initBufferPool(bm, "testbuffer.bin", 40, strategies[s], NULL));
+      CHECK(setReadAhead(bm, 16));
+      for (i = 0; i < 100; i++)
+      {
+	  CHECK(pinPage(bm, h, i));
+	  sprintf(expected, "Page-%i", i);
+	  ASSERT_EQUALS_STRING(expected, h->data, "scanned page content");
+	  CHECK(unpinPage(bm, h));
+      }
+      ASSERT_EQUALS_INT(100, getNumReadIO(bm), "every page read once");
+      ASSERT_EQUALS_INT(98, getNumReadAheadIO(bm), "all but the first two pages read ahead");
+      CHECK(shutdownBufferPool(bm));
+  }
+
+  // six hot pages and a short scan fill the pool, the pages read ahead are evicted first
+  CHECK(initBufferPool(bm, "testbuffer.bin", 12, RS_LRU, NULL));
+  CHECK(setReadAhead(bm, 3));
+  for (i = 0; i < 6; i++)
+  {
+      CHECK(pinPage(bm, h, hot[i]));
+      CHECK(unpinPage(bm, h));
+  }
+  for (i = 80; i < 83; i++)
+  {
+      CHECK(pinPage(bm, h, i));
+      CHECK(unpinPage(bm, h));
+  }
+  ASSERT_EQUALS_INT(3, getNumReadAheadIO(bm), "pages 83 to 85 read ahead");
+  CHECK(pinPage(bm, h, 70));
+  CHECK(unpinPage(bm, h));
+  for (i = 0; i < 12; i++)
+    ASSERT_TRUE(getFrameContents(bm)[i] != 85, "a page read ahead was the victim");
+  reads = getNumReadIO(bm);
+  for (i = 0; i < 6; i++)
+  {
+      CHECK(pinPage(bm, h, hot[i]));
+      CHECK(unpinPage(bm, h));
+  }
+  CHECK(pinPage(bm, h, 83));
+  CHECK(unpinPage(bm, h));
+  ASSERT_EQUALS_INT(reads, getNumReadIO(bm), "hot pages and page 83 still in the pool");
+  CHECK(shutdownBufferPool(bm));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// several threads pin, update and unpin overlapping pages of a pool far smaller
+// than the file. Every thread owns the pages p with p % threads == its number
+// and counts its updates in them, it only reads the pages of the others.
+// Every other strategy runs on a pool of two shards.
+#define CONCURRENT_THREADS 4
+#define CONCURRENT_PAGES 64
+#define CONCURRENT_PINS 3000
+
+struct pinWorker {
+  BM_BufferPool *bm;
+  int id;
+  int updates[CONCURRENT_PAGES];
+  int failures;
+};
+
+static void *
+pinWorkerMain (void *arg)
+{
+  struct pinWorker *worker = arg;
+  BM_PageHandle h;
+  char expected[16];
+  unsigned seed = worker->id + 1;
+  int i, pageNum;
+
+  for (i = 0; i < CONCURRENT_PINS; i++)
+  {
+      seed = seed * 1103515245 + 12345;
+      pageNum = (seed >> 8) % CONCURRENT_PAGES;
+      if (pinPage(worker->bm, &h, pageNum) != RC_OK)
+      {
+          worker->failures++;
+          continue;
+      }
+      sprintf(expected, "Page-%i", pageNum);
+      if (strcmp(expected, h.data) != 0)
+          worker->failures++;
+      if (pageNum % CONCURRENT_THREADS == worker->id)
+      {
+          (*(int *) (h.data + 32))++;
+          worker->updates[pageNum]++;
+          if (markDirty(worker->bm, &h) != RC_OK)
+              worker->failures++;
+      }
+      if (unpinPage(worker->bm, &h) != RC_OK)
+          worker->failures++;
+  }
+  return NULL;
+}
+
+void
+testConcurrentPins ()
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  ReplacementStrategy strategies[] = { RS_FIFO, RS_LRU, RS_CLOCK, RS_LFU, RS_LRU_K, RS_ARC, RS_2Q, RS_CLOCK_LOCKFREE };
+  struct pinWorker workers[CONCURRENT_THREADS];
+  pthread_t threads[CONCURRENT_THREADS];
+  int s, t, i, updates;
+
+  testName = "Concurrent pins";
+
+  for (s = 0; s < 8; s++)
+  {
+      CHECK(createPageFile("testbuffer.bin"));
+      CHECK(initBufferPool(bm, "testbuffer.bin", 8, RS_FIFO, NULL));
+      for (i = 0; i < CONCURRENT_PAGES; i++)
+      {
+          CHECK(pinPage(bm, h, i));
+          sprintf(h->data, "Page-%i", i);
+          *(int *) (h->data + 32) = 0;
+          CHECK(markDirty(bm, h));
+          CHECK(unpinPage(bm, h));
+      }
+      CHECK(shutdownBufferPool(bm));
+
+      CHECK(initBufferPoolSharded(bm, "testbuffer.bin", 16, strategies[s], NULL, SM_IO_BUFFERED, 1 + s % 2));
+      for (t = 0; t < CONCURRENT_THREADS; t++)
+      {
+          memset(&workers[t], 0, sizeof (struct pinWorker));
+          workers[t].bm = bm;
+          workers[t].id = t;
+          ASSERT_TRUE(pthread_create(&threads[t], NULL, pinWorkerMain, &workers[t]) == 0, "starting thread");
+      }
+      for (t = 0; t < CONCURRENT_THREADS; t++)
+      {
+          pthread_join(threads[t], NULL);
+          ASSERT_EQUALS_INT(0, workers[t].failures, "every pin found its page");
+      }
+      for (i = 0; i < 16; i++)
+          ASSERT_EQUALS_INT(0, getFixCounts(bm)[i], "every frame is unpinned");
+      CHECK(shutdownBufferPool(bm));
+
+      CHECK(initBufferPool(bm, "testbuffer.bin", 4, RS_FIFO, NULL));
+      for (i = 0; i < CONCURRENT_PAGES; i++)
+      {
+          updates = 0;
+          for (t = 0; t < CONCURRENT_THREADS; t++)
+              updates += workers[t].updates[i];
+          CHECK(pinPage(bm, h, i));
+          ASSERT_EQUALS_INT(updates, *(int *) (h->data + 32), "no update was lost");
+          CHECK(unpinPage(bm, h));
+      }
+      CHECK(shutdownBufferPool(bm));
+      CHECK(destroyPageFile("testbuffer.bin"));
+  }
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// a pool split into shards behaves like one pool: every page is read once by
+// a scan, the counters and frame arrays cover all shards and the dirty pages
+// of every shard are written back. Read-ahead works across shard extents.
+void
+testShardedPool ()
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  ReplacementStrategy strategies[] = { RS_FIFO, RS_LRU, RS_CLOCK, RS_LFU, RS_LRU_K, RS_ARC, RS_2Q, RS_CLOCK_LOCKFREE };
+  char expected[16];
+  int s, i, resident;
+
+  testName = "Sharded pool";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  for (s = 0; s < 8; s++)
+  {
+      CHECK(initBufferPoolSharded(bm, "testbuffer.bin", 64, strategies[s], NULL, SM_IO_BUFFERED, 4));
+      for (i = 0; i < 200; i++)
+      {
+          CHECK(pinPage(bm, h, i));
+          sprintf(h->data, "Page-%i-%i", i, s);
+          CHECK(markDirty(bm, h));
+          CHECK(unpinPage(bm, h));
+      }
+      ASSERT_EQUALS_INT(200, getNumReadIO(bm), "every page read once");
+      resident = 0;
+      for (i = 0; i < 64; i++)
+      {
+          resident += (getFrameContents(bm)[i] != NO_PAGE) ? 1 : 0;
+          ASSERT_EQUALS_INT(0, getFixCounts(bm)[i], "every frame is unpinned");
+      }
+      ASSERT_EQUALS_INT(64, resident, "every frame of every shard is in use");
+      CHECK(forceFlushPool(bm));
+      ASSERT_EQUALS_INT(200, getNumWriteIO(bm), "evicted and flushed pages of all shards");
+      for (i = 0; i < 64; i++)
+          ASSERT_TRUE(!getDirtyFlags(bm)[i], "flush cleaned every shard");
+      CHECK(shutdownBufferPool(bm));
+
+      CHECK(initBufferPoolSharded(bm, "testbuffer.bin", 64, strategies[s], NULL, SM_IO_BUFFERED, 4));
+      CHECK(setReadAhead(bm, 8));
+      for (i = 0; i < 200; i++)
+      {
+          CHECK(pinPage(bm, h, i));
+          sprintf(expected, "Page-%i-%i", i, s);
+          ASSERT_EQUALS_STRING(expected, h->data, "reading back page of a shard");
+          CHECK(unpinPage(bm, h));
+      }
+      ASSERT_EQUALS_INT(200, getNumReadIO(bm), "scan reads every page once");
+      ASSERT_EQUALS_INT(198, getNumReadAheadIO(bm), "scan served by read-ahead across shards");
+      CHECK(shutdownBufferPool(bm));
+  }
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// the latch of a page is held shared by several handles at once and keeps
+// markDirty out until the readers are gone. Then writers fill whole pages
+// with one letter under the exclusive latch while readers check under the
+// shared latch that they never see a page half written.
+#define LATCH_THREADS 4
+#define LATCH_PAGES 8
+#define LATCH_ROUNDS 2000
+
+struct latchWorker {
+  BM_BufferPool *bm;
+  int id;
+  int failures;
+};
+
+static void *
+latchWorkerMain (void *arg)
+{
+  struct latchWorker *worker = arg;
+  BM_PageHandle h;
+  unsigned seed = worker->id + 1;
+  int i, j, pageNum;
+
+  for (i = 0; i < LATCH_ROUNDS; i++)
+  {
+      seed = seed * 1103515245 + 12345;
+      pageNum = (seed >> 8) % LATCH_PAGES;
+      if (pinPage(worker->bm, &h, pageNum) != RC_OK)
+      {
+          worker->failures++;
+          continue;
+      }
+      if (worker->id % 2 == 0) //writer
+      {
+          CHECK(latchPage(worker->bm, &h, BM_LATCH_EXCLUSIVE));
+          memset(h.data, 'a' + (seed >> 12) % 26, PAGE_SIZE);
+          if (markDirty(worker->bm, &h) != RC_OK)
+              worker->failures++;
+      }
+      else
+      {
+          CHECK(latchPage(worker->bm, &h, BM_LATCH_SHARED));
+          for (j = 1; j < PAGE_SIZE; j++)
+              if (h.data[j] != h.data[0])
+              {
+                  worker->failures++;
+                  break;
+              }
+      }
+      CHECK(unlatchPage(worker->bm, &h));
+      if (unpinPage(worker->bm, &h) != RC_OK)
+          worker->failures++;
+  }
+  return NULL;
+}
+
+void
+testPageLatches ()
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  BM_PageHandle *other = MAKE_PAGE_HANDLE();
+  struct latchWorker workers[LATCH_THREADS];
+  pthread_t threads[LATCH_THREADS];
+  int t, i;
+
+  testName = "Page latches";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  CHECK(initBufferPool(bm, "testbuffer.bin", 4, RS_LRU, NULL));
+  CHECK(pinPage(bm, h, 0));
+  CHECK(pinPage(bm, other, 0));
+  CHECK(latchPage(bm, h, BM_LATCH_SHARED));
+  CHECK(latchPage(bm, other, BM_LATCH_SHARED));
+  ASSERT_EQUALS_INT(RC_PAGE_LATCHED_SHARED, markDirty(bm, h), "no markDirty under a shared latch");
+  CHECK(unlatchPage(bm, other));
+  CHECK(unpinPage(bm, other));
+  CHECK(unlatchPage(bm, h));
+  CHECK(latchPage(bm, h, BM_LATCH_EXCLUSIVE));
+  memset(h->data, 'x', PAGE_SIZE);
+  CHECK(markDirty(bm, h));
+  CHECK(unlatchPage(bm, h));
+  CHECK(unpinPage(bm, h));
+  ASSERT_EQUALS_INT(PAGE_NODE_NOT_FOUND, latchPage(bm, h, BM_LATCH_SHARED), "latching needs a pinned page");
+  for (i = 0; i < LATCH_PAGES; i++)
+  {
+      CHECK(pinPage(bm, h, i));
+      memset(h->data, 'x', PAGE_SIZE);
+      CHECK(markDirty(bm, h));
+      CHECK(unpinPage(bm, h));
+  }
+  CHECK(shutdownBufferPool(bm));
+
+  CHECK(initBufferPoolSharded(bm, "testbuffer.bin", 16, RS_CLOCK, NULL, SM_IO_BUFFERED, 2));
+  for (t = 0; t < LATCH_THREADS; t++)
+  {
+      memset(&workers[t], 0, sizeof (struct latchWorker));
+      workers[t].bm = bm;
+      workers[t].id = t;
+      ASSERT_TRUE(pthread_create(&threads[t], NULL, latchWorkerMain, &workers[t]) == 0, "starting thread");
+  }
+  for (t = 0; t < LATCH_THREADS; t++)
+  {
+      pthread_join(threads[t], NULL);
+      ASSERT_EQUALS_INT(0, workers[t].failures, "readers never saw a page half written");
+  }
+  CHECK(shutdownBufferPool(bm));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  free(other);
+  TEST_DONE();
+}
+
+// an optimistic read holds until an exclusive latch or an eviction touches
+// the page and fails for pages that aren't in the pool. Then writers stamp
+// pages with one number under the exclusive latch while readers read them
+// optimistically and never accept a read that mixes two stamps.
+#define OPTIMISTIC_WORDS 64
+
+struct optimisticWorker {
+  BM_BufferPool *bm;
+  int id;
+  int validated;
+  int failures;
+};
+
+static void *
+optimisticWorkerMain (void *arg)
+{
+  struct optimisticWorker *worker = arg;
+  BM_PageHandle h;
+  unsigned seed = worker->id + 1;
+  unsigned int version;
+  int words[OPTIMISTIC_WORDS];
+  int i, j, pageNum;
+
+  h.pageNum = NO_PAGE;
+  h.data = NULL;
+  for (i = 0; i < LATCH_ROUNDS; i++)
+  {
+      seed = seed * 1103515245 + 12345;
+      pageNum = (seed >> 8) % LATCH_PAGES;
+      if (worker->id == 0) //writer
+      {
+          CHECK(pinPage(worker->bm, &h, pageNum));
+          CHECK(latchPage(worker->bm, &h, BM_LATCH_EXCLUSIVE));
+          for (j = 0; j < OPTIMISTIC_WORDS; j++)
+              __atomic_store_n((int *) h.data + j, i, __ATOMIC_RELAXED);
+          CHECK(markDirty(worker->bm, &h));
+          CHECK(unlatchPage(worker->bm, &h));
+          CHECK(unpinPage(worker->bm, &h));
+          continue;
+      }
+      if (beginOptimisticRead(worker->bm, &h, pageNum, &version) != RC_OK)
+          continue;
+      for (j = 0; j < OPTIMISTIC_WORDS; j++)
+          words[j] = __atomic_load_n((int *) h.data + j, __ATOMIC_RELAXED);
+      if (!validateOptimisticRead(worker->bm, &h, version))
+          continue;
+      worker->validated++;
+      for (j = 1; j < OPTIMISTIC_WORDS; j++)
+          if (words[j] != words[0])
+          {
+              worker->failures++;
+              break;
+          }
+  }
+  return NULL;
+}
+
+void
+testOptimisticReads ()
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  BM_PageHandle *reader = MAKE_PAGE_HANDLE();
+  struct optimisticWorker workers[LATCH_THREADS];
+  pthread_t threads[LATCH_THREADS];
+  unsigned int version;
+  int t, i;
+
+  testName = "Optimistic reads";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+  reader->pageNum = NO_PAGE;
+  ASSERT_EQUALS_INT(RC_NON_EXISTING_PAGE_IN_FRAME, beginOptimisticRead(bm, reader, 0, &version), "page not in the pool");
+  CHECK(pinPage(bm, h, 0));
+  sprintf(h->data, "%s", "Page-0");
+  CHECK(unpinPage(bm, h));
+  CHECK(beginOptimisticRead(bm, reader, 0, &version));
+  ASSERT_EQUALS_STRING("Page-0", reader->data, "reading without a pin");
+  ASSERT_EQUALS_INT(0, getFixCounts(bm)[0], "the read took no pin");
+  ASSERT_TRUE(validateOptimisticRead(bm, reader, version), "nothing changed the page");
+
+  CHECK(pinPage(bm, h, 0));
+  CHECK(latchPage(bm, h, BM_LATCH_SHARED));
+  ASSERT_TRUE(validateOptimisticRead(bm, reader, version), "readers don't change the version");
+  CHECK(unlatchPage(bm, h));
+  CHECK(latchPage(bm, h, BM_LATCH_EXCLUSIVE));
+  ASSERT_EQUALS_INT(RC_NON_EXISTING_PAGE_IN_FRAME, beginOptimisticRead(bm, reader, 0, &version), "a writer holds the page");
+  sprintf(h->data, "%s", "Page-0-b");
+  CHECK(markDirty(bm, h));
+  CHECK(unlatchPage(bm, h));
+  CHECK(unpinPage(bm, h));
+  ASSERT_TRUE(!validateOptimisticRead(bm, reader, version), "a writer changed the page");
+
+  CHECK(beginOptimisticRead(bm, reader, 0, &version));
+  ASSERT_EQUALS_STRING("Page-0-b", reader->data, "reading the new content");
+  for (i = 1; i < 4; i++)
+  {
+      CHECK(pinPage(bm, h, i));
+      CHECK(unpinPage(bm, h));
+  }
+  ASSERT_TRUE(!validateOptimisticRead(bm, reader, version), "the page was evicted");
+  ASSERT_EQUALS_INT(RC_NON_EXISTING_PAGE_IN_FRAME, beginOptimisticRead(bm, reader, 0, &version), "evicted page");
+  CHECK(shutdownBufferPool(bm));
+
+  // no evictions in the concurrent part: the readers only ever see pages written under the latch
+  CHECK(initBufferPoolSharded(bm, "testbuffer.bin", 16, RS_LRU, NULL, SM_IO_BUFFERED, 2));
+  for (i = 0; i < LATCH_PAGES; i++)
+  {
+      CHECK(pinPage(bm, h, i));
+      memset(h->data, 0, OPTIMISTIC_WORDS * sizeof(int));
+      CHECK(markDirty(bm, h));
+      CHECK(unpinPage(bm, h));
+  }
+  for (t = 0; t < LATCH_THREADS; t++)
+  {
+      memset(&workers[t], 0, sizeof (struct optimisticWorker));
+      workers[t].bm = bm;
+      workers[t].id = t;
+      ASSERT_TRUE(pthread_create(&threads[t], NULL, optimisticWorkerMain, &workers[t]) == 0, "starting thread");
+  }
+  for (t = 0; t < LATCH_THREADS; t++)
+  {
+      pthread_join(threads[t], NULL);
+      ASSERT_EQUALS_INT(0, workers[t].failures, "no validated read mixed two writes");
+      if (t > 0)
+          ASSERT_TRUE(workers[t].validated > 0, "optimistic reads succeed");
+  }
+  for (i = 0; i < 16; i++)
+      ASSERT_EQUALS_INT(0, getFixCounts(bm)[i], "readers took no pins");
+  CHECK(shutdownBufferPool(bm));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  free(reader);
+  TEST_DONE();
+}
+
+// two pools share a budget of 48 frames. B touches its pages once and is
+// left alone while A keeps missing on pages it evicted lately, so frames
+// move from B, down to its minimum, to A. The frames in use never exceed
+// the budget and the pages of B come back from disk intact.
+void
+testFrameBudget ()
+{
+  BM_BufferPool *a = MAKE_POOL();
+  BM_BufferPool *b = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  char expected[16];
+  unsigned seed = 1;
+  int i, pageNum, inUse, maxInUse = 0;
+
+  testName = "Frame budget";
+
+  CHECK(createPageFile("testbudget_a.bin"));
+  CHECK(createPageFile("testbudget_b.bin"));
+
+  CHECK(setFrameBudget(12));
+  CHECK(initBufferPool(a, "testbudget_a.bin", 64, RS_CLOCK, NULL));
+  ASSERT_EQUALS_INT(RC_FRAME_BUDGET_EXCEEDED, initBufferPool(b, "testbudget_b.bin", 64, RS_LRU, NULL), "no room for the minimum of a second pool");
+  ASSERT_EQUALS_INT(RC_FRAME_BUDGET_IN_USE, setFrameBudget(48), "budget can't change under an open pool");
+  CHECK(shutdownBufferPool(a));
+
+  CHECK(setFrameBudget(48));
+  CHECK(initBufferPool(a, "testbudget_a.bin", 64, RS_CLOCK, NULL));
+  CHECK(initBufferPool(b, "testbudget_b.bin", 64, RS_LRU, NULL));
+  for (i = 0; i < 24; i++)
+  {
+      CHECK(pinPage(b, h, i));
+      sprintf(h->data, "B-%i", i);
+      CHECK(markDirty(b, h));
+      CHECK(unpinPage(b, h));
+  }
+  ASSERT_EQUALS_INT(24, getNumFramesInUse(b), "B took a frame per page");
+  for (i = 0; i < 64; i++)
+  {
+      CHECK(pinPage(a, h, i));
+      sprintf(h->data, "A-%i", i);
+      CHECK(markDirty(a, h));
+      CHECK(unpinPage(a, h));
+  }
+  ASSERT_EQUALS_INT(24, getNumFramesInUse(a), "A grew until the budget ran out");
+  for (i = 0; i < 4000; i++)
+  {
+      seed = seed * 1103515245 + 12345;
+      pageNum = (seed >> 8) % 64;
+      CHECK(pinPage(a, h, pageNum));
+      sprintf(expected, "A-%i", pageNum);
+      ASSERT_EQUALS_STRING(expected, h->data, "page of A survived eviction");
+      CHECK(unpinPage(a, h));
+      inUse = getNumFramesInUse(a) + getNumFramesInUse(b);
+      maxInUse = (inUse > maxInUse) ? inUse : maxInUse;
+  }
+  ASSERT_TRUE(maxInUse <= 48, "frames in use never exceeded the budget");
+  ASSERT_EQUALS_INT(8, getNumFramesInUse(b), "B shrank to its minimum");
+  ASSERT_EQUALS_INT(40, getNumFramesInUse(a), "A got the frames of B");
+  for (i = 0; i < 24; i++)
+  {
+      CHECK(pinPage(b, h, i));
+      sprintf(expected, "B-%i", i);
+      ASSERT_EQUALS_STRING(expected, h->data, "page of B written back when its frame was parked");
+      CHECK(unpinPage(b, h));
+  }
+  ASSERT_EQUALS_INT(8, getNumFramesInUse(b), "B stays within its share");
+  CHECK(shutdownBufferPool(a));
+  CHECK(shutdownBufferPool(b));
+  CHECK(setFrameBudget(0));
+  CHECK(destroyPageFile("testbudget_a.bin"));
+  CHECK(destroyPageFile("testbudget_b.bin"));
+
+  free(a);
+  free(b);
+  free(h);
+  TEST_DONE();
+}
+
+// pinPages pins hits and misses in any order, reads every missing page once
+// and pins a page asked for twice twice. A batch larger than the pool pins
+// nothing, a negative count is refused. In a sharded pool a run crossing an
+// extent is split.
+void
+testBatchPins ()
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  BM_PageHandle handles[20];
+  PageNumber pageNums[20] = { 8, 6, 20, 7, 5, 21, 6, 30 };
+  PageNumber hits[3] = { 9, 5, 10 };
+  char expected[16];
+  int i, fixed, reads;
+
+  testName = "Batch pins";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  CHECK(initBufferPool(bm, "testbuffer.bin", 16, RS_LRU, NULL));
+  for (i = 0; i < 40; i++)
+  {
+      CHECK(pinPage(bm, h, i));
+      sprintf(h->data, "Page-%i", i);
+      CHECK(markDirty(bm, h));
+      CHECK(unpinPage(bm, h));
+  }
+  CHECK(shutdownBufferPool(bm));
+
+  CHECK(initBufferPool(bm, "testbuffer.bin", 16, RS_LRU, NULL));
+  CHECK(pinPages(bm, handles, pageNums, 8));
+  ASSERT_EQUALS_INT(7, getNumReadIO(bm), "every missing page read once");
+  for (i = 0; i < 8; i++)
+  {
+      ASSERT_EQUALS_INT(pageNums[i], handles[i].pageNum, "handle of its page");
+      sprintf(expected, "Page-%i", pageNums[i]);
+      ASSERT_EQUALS_STRING(expected, handles[i].data, "batch read the page");
+  }
+  fixed = 0;
+  for (i = 0; i < 16; i++)
+      fixed += getFixCounts(bm)[i];
+  ASSERT_EQUALS_INT(8, fixed, "a pin per handle, page 6 pinned twice");
+  CHECK(pinPages(bm, handles + 8, hits, 3));
+  ASSERT_EQUALS_INT(9, getNumReadIO(bm), "page 5 was a hit");
+  CHECK(unpinPages(bm, handles, 11));
+  for (i = 0; i < 16; i++)
+      ASSERT_EQUALS_INT(0, getFixCounts(bm)[i], "every frame unpinned");
+
+  for (i = 0; i < 20; i++)
+      pageNums[i] = 39 - i;
+  ASSERT_EQUALS_INT(PAGE_NODE_NOT_FOUND, pinPages(bm, handles, pageNums, 20), "more pages than frames");
+  for (i = 0; i < 16; i++)
+      ASSERT_EQUALS_INT(0, getFixCounts(bm)[i], "a failed batch pins nothing");
+  ASSERT_EQUALS_INT(RC_INVALID_PAGE_COUNT, pinPages(bm, handles, pageNums, -3), "negative count pins");
+  ASSERT_EQUALS_INT(RC_INVALID_PAGE_COUNT, unpinPages(bm, handles, -3), "negative count unpins");
+  reads = getNumReadIO(bm);
+  CHECK(pinPages(bm, handles, pageNums, 0));
+  ASSERT_EQUALS_INT(reads, getNumReadIO(bm), "an empty batch reads nothing");
+  CHECK(shutdownBufferPool(bm));
+
+  CHECK(initBufferPoolSharded(bm, "testbuffer.bin", 32, RS_CLOCK, NULL, SM_IO_BUFFERED, 4));
+  for (i = 0; i < 8; i++)
+      pageNums[i] = 12 + i;
+  CHECK(pinPages(bm, handles, pageNums, 8));
+  ASSERT_EQUALS_INT(8, getNumReadIO(bm), "run split between two shards");
+  for (i = 0; i < 8; i++)
+  {
+      sprintf(expected, "Page-%i", pageNums[i]);
+      ASSERT_EQUALS_STRING(expected, handles[i].data, "batch read the page of its shard");
+  }
+  CHECK(unpinPages(bm, handles, 8));
+  CHECK(shutdownBufferPool(bm));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// a hot set of 40 pages survives a bulk read of 400 pages and a bulk write
+// of 100 pages under every strategy: both recycle a ring of 64 / 8 frames.
+// A ring page pinned normally joins the pool and stays.
+void
+testAccessStrategies ()
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  BM_AccessStrategy *ring;
+  ReplacementStrategy strategies[] = { RS_FIFO, RS_LRU, RS_CLOCK, RS_LFU, RS_LRU_K, RS_ARC, RS_2Q, RS_CLOCK_LOCKFREE };
+  char expected[16];
+  int s, i, reads, writes;
+
+  testName = "Access strategies";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  CHECK(initBufferPool(bm, "testbuffer.bin", 64, RS_FIFO, NULL));
+  ASSERT_TRUE(getAccessStrategy(bm, BM_ACCESS_NORMAL) == NULL, "a normal access needs no ring");
+  for (i = 0; i < 500; i++)
+  {
+      CHECK(pinPage(bm, h, i));
+      sprintf(h->data, "Page-%i", i);
+      CHECK(markDirty(bm, h));
+      CHECK(unpinPage(bm, h));
+  }
+  CHECK(shutdownBufferPool(bm));
+
+  for (s = 0; s < 8; s++)
+  {
+      CHECK(initBufferPool(bm, "testbuffer.bin", 64, strategies[s], NULL));
+      for (i = 0; i < 40; i++)
+      {
+          CHECK(pinPage(bm, h, i));
+          CHECK(unpinPage(bm, h));
+      }
+
+      ring = getAccessStrategy(bm, BM_ACCESS_BULK_READ);
+      for (i = 100; i < 500; i++)
+      {
+          CHECK(pinPageWithStrategy(bm, h, i, ring));
+          sprintf(expected, "Page-%i", i);
+          ASSERT_EQUALS_STRING(expected, h->data, "bulk read the page");
+          CHECK(unpinPage(bm, h));
+          if (i == 100)
+          {
+              CHECK(pinPage(bm, h, 100)); //wanted by another client
+              CHECK(unpinPage(bm, h));
+          }
+      }
+      freeAccessStrategy(ring);
+      reads = getNumReadIO(bm);
+      ASSERT_EQUALS_INT(440, reads, "every page read once");
+      for (i = 0; i < 40; i++)
+      {
+          CHECK(pinPage(bm, h, i));
+          CHECK(unpinPage(bm, h));
+      }
+      CHECK(pinPage(bm, h, 100));
+      CHECK(unpinPage(bm, h));
+      ASSERT_EQUALS_INT(reads, getNumReadIO(bm), "hot set and the page in demand survived the scan");
+
+      ring = getAccessStrategy(bm, BM_ACCESS_BULK_WRITE);
+      for (i = 400; i < 500; i++)
+      {
+          CHECK(pinPageWithStrategy(bm, h, i, ring));
+          sprintf(h->data, "Page-%i", i);
+          CHECK(markDirty(bm, h));
+          CHECK(unpinPage(bm, h));
+      }
+      writes = getNumWriteIO(bm);
+      ASSERT_EQUALS_INT(100 - 8 - 8, writes, "ring wrote back all but its last pages, the scan left pages 492 to 499 in the pool");
+      freeAccessStrategy(ring);
+      reads = getNumReadIO(bm);
+      for (i = 0; i < 40; i++)
+      {
+          CHECK(pinPage(bm, h, i));
+          CHECK(unpinPage(bm, h));
+      }
+      ASSERT_EQUALS_INT(reads, getNumReadIO(bm), "hot set survived the bulk write");
+      CHECK(shutdownBufferPool(bm));
+  }
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// 34 asynchronous pins are in flight at once, through io_uring for buffered
+// and direct I/O and read synchronously for a mapped file. A page asked for
+// twice is read once and pinned twice, pinPage of a page in flight waits
+// for its read.
+void
+testAsyncPins ()
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  BM_PageHandle handles[34];
+  BM_PinRequest *requests[34];
+  SM_IOMode modes[] = { SM_IO_BUFFERED, SM_IO_DIRECT, SM_IO_MMAP };
+  char expected[16];
+  int m, i, fixed;
+
+  testName = "Asynchronous pins";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  CHECK(initBufferPool(bm, "testbuffer.bin", 16, RS_LRU, NULL));
+  for (i = 0; i < 40; i++)
+  {
+      CHECK(pinPage(bm, h, i));
+      sprintf(h->data, "Page-%i", i);
+      CHECK(markDirty(bm, h));
+      CHECK(unpinPage(bm, h));
+  }
+  CHECK(shutdownBufferPool(bm));
+
+  for (m = 0; m < 3; m++)
+  {
+      CHECK(initBufferPoolSharded(bm, "testbuffer.bin", 64, RS_CLOCK, NULL, modes[m], 1));
+      for (i = 0; i < 32; i++)
+          CHECK(pinPageAsync(bm, 39 - i, &requests[i]));
+      CHECK(pinPageAsync(bm, 20, &requests[32]));
+      CHECK(pinPageAsync(bm, 35, &requests[33]));
+      CHECK(pinPage(bm, h, 39));
+      ASSERT_EQUALS_STRING("Page-39", h->data, "pinPage waited for the read in flight");
+      CHECK(unpinPage(bm, h));
+
+      for (i = 33; i >= 0; i--)
+      {
+          CHECK(waitPin(requests[i], &handles[i]));
+          ASSERT_TRUE(handles[i].pageNum == (i < 32 ? 39 - i : (i == 32 ? 20 : 35)), "handle of its page");
+          sprintf(expected, "Page-%i", handles[i].pageNum);
+          ASSERT_EQUALS_STRING(expected, handles[i].data, "async pin read the page");
+      }
+      ASSERT_EQUALS_INT(32, getNumReadIO(bm), "every missing page read once");
+      fixed = 0;
+      for (i = 0; i < 64; i++)
+          fixed += getFixCounts(bm)[i];
+      ASSERT_EQUALS_INT(34, fixed, "a pin per request, pages 20 and 35 pinned twice");
+      CHECK(unpinPages(bm, handles, 34));
+
+      CHECK(pinPageAsync(bm, 39, &requests[0]));
+      ASSERT_TRUE(pinReady(requests[0]), "a page in the pool is ready at once");
+      CHECK(waitPin(requests[0], &handles[0]));
+      CHECK(unpinPage(bm, &handles[0]));
+      ASSERT_EQUALS_INT(32, getNumReadIO(bm), "no read for a hit");
+      CHECK(shutdownBufferPool(bm));
+  }
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// sessions walking the same new pages at once: every thread pins pages 0 to
+// 255 in order, one half from page 0 on, the other from page 128 on. Every
+// page is read once however many threads missed it, adjacent misses may
+// share a read.
+struct scanWorker {
+  BM_BufferPool *bm;
+  int first;
+  int failures;
+};
+
+static void *
+scanWorkerMain (void *arg)
+{
+  struct scanWorker *worker = arg;
+  BM_PageHandle h;
+  char expected[16];
+  int i, pageNum;
+
+  for (i = 0; i < 256; i++)
+  {
+      pageNum = (worker->first + i) % 256;
+      if (pinPage(worker->bm, &h, pageNum) != RC_OK)
+      {
+          worker->failures++;
+          continue;
+      }
+      sprintf(expected, "Page-%i", pageNum);
+      if (strcmp(expected, h.data) != 0)
+          worker->failures++;
+      if (unpinPage(worker->bm, &h) != RC_OK)
+          worker->failures++;
+  }
+  return NULL;
+}
+
+void
+testMergedReads ()
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  SM_IOMode modes[] = { SM_IO_BUFFERED, SM_IO_DIRECT, SM_IO_MMAP };
+  struct scanWorker workers[8];
+  pthread_t threads[8];
+  int m, t, i;
+
+  testName = "Merged reads";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  CHECK(initBufferPool(bm, "testbuffer.bin", 16, RS_LRU, NULL));
+  for (i = 0; i < 256; i++)
+  {
+      CHECK(pinPage(bm, h, i));
+      sprintf(h->data, "Page-%i", i);
+      CHECK(markDirty(bm, h));
+      CHECK(unpinPage(bm, h));
+  }
+  CHECK(shutdownBufferPool(bm));
+
+  for (m = 0; m < 3; m++)
+  {
+      CHECK(initBufferPoolSharded(bm, "testbuffer.bin", 256, RS_CLOCK, NULL, modes[m], 1 << m));
+      for (t = 0; t < 8; t++)
+      {
+          workers[t].bm = bm;
+          workers[t].first = (t % 2) * 128;
+          workers[t].failures = 0;
+          ASSERT_TRUE(pthread_create(&threads[t], NULL, scanWorkerMain, &workers[t]) == 0, "starting thread");
+      }
+      for (t = 0; t < 8; t++)
+      {
+          pthread_join(threads[t], NULL);
+          ASSERT_EQUALS_INT(0, workers[t].failures, "every pin found its page");
+      }
+      ASSERT_EQUALS_INT(256, getNumReadIO(bm), "every page read once");
+      ASSERT_TRUE(getNumMergedReadIO(bm) < 256, "a merged read counts its pages but the first");
+      for (i = 0; i < 256; i++)
+          ASSERT_EQUALS_INT(0, getFixCounts(bm)[i], "every frame is unpinned");
+      CHECK(shutdownBufferPool(bm));
+  }
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// a dirty flag only reads clean once the page is on disk: every round
+// changes a page, marks it dirty and flushes the pool from another thread,
+// while this one waits for the flag to read clean and then finds the change
+// in the page file. The flushes go through the pwritev workers, whose writes
+// leave this thread time to look. A change made during a flush leaves the
+// page dirty.
+static void *
+flushWorkerMain (void *arg)
+{
+  forceFlushPool(arg);
+  return NULL;
+}
+
+void
+testDirtyDuringFlush ()
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  SM_FileHandle fh;
+  SM_PageHandle onDisk = malloc(PAGE_SIZE);
+  pthread_t flusher;
+  int round, failures = 0;
+
+  testName = "Dirty flags during flushes";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  CHECK(openPageFile("testbuffer.bin", &fh));
+  CHECK(ensureCapacity(1, &fh));
+  CHECK(initBufferPool(bm, "testbuffer.bin", 4, RS_LRU, NULL));
+  CHECK(pinPage(bm, h, 0));
+  setBatchWriteEngine(SM_BATCH_THREADS);
+  for (round = 1; round <= 300; round++)
+  {
+      *(int *) h->data = round;
+      CHECK(markDirty(bm, h));
+      ASSERT_TRUE(pthread_create(&flusher, NULL, flushWorkerMain, bm) == 0, "starting thread");
+      while (__atomic_load_n(&getDirtyFlags(bm)[0], __ATOMIC_ACQUIRE)) //the flusher clears it meanwhile
+          sched_yield();
+      CHECK(readBlock(0, &fh, onDisk));
+      if (*(int *) onDisk != round)
+          failures++;
+      pthread_join(flusher, NULL);
+  }
+  ASSERT_EQUALS_INT(0, failures, "a page reading clean was on disk");
+
+  ASSERT_TRUE(pthread_create(&flusher, NULL, flushWorkerMain, bm) == 0, "starting thread");
+  CHECK(latchPage(bm, h, BM_LATCH_EXCLUSIVE));
+  *(int *) h->data = -1;
+  CHECK(markDirty(bm, h));
+  CHECK(unlatchPage(bm, h));
+  pthread_join(flusher, NULL);
+  ASSERT_TRUE(getDirtyFlags(bm)[0] || (readBlock(0, &fh, onDisk) == RC_OK && *(int *) onDisk == -1), "a change during a flush is on disk or the page is dirty");
+  setBatchWriteEngine(SM_BATCH_AUTO);
+  CHECK(forceFlushPool(bm));
+  ASSERT_TRUE(!getDirtyFlags(bm)[0], "flushed");
+  CHECK(readBlock(0, &fh, onDisk));
+  ASSERT_EQUALS_INT(-1, *(int *) onDisk, "the last change is on disk");
+  CHECK(unpinPage(bm, h));
+  CHECK(shutdownBufferPool(bm));
+  CHECK(closePageFile(&fh));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(onDisk);
+  free(bm);
+  free(h);
+  TEST_DONE();
+}